@@ -0,0 +1,592 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamConvertKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if VCAM_X86
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    else
+#        include <cpuid.h>
+#    endif
+#endif
+
+namespace vcam
+{
+namespace
+{
+#if VCAM_X86
+    void cpuid(u32 info[4], u32 leaf, u32 subleaf)
+    {
+#    if defined(_MSC_VER)
+        __cpuidex(reinterpret_cast<int*>(info), static_cast<int>(leaf), static_cast<int>(subleaf));
+#    else
+        __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#    endif
+    }
+
+    u64 xgetbv0()
+    {
+#    if defined(_MSC_VER)
+        return _xgetbv(0);
+#    else
+        u32 eax = 0;
+        u32 edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<u64>(edx) << 32) | eax;
+#    endif
+    }
+#endif
+
+    Isa detectCpuIsa()
+    {
+#if VCAM_X86
+        u32 info[4] = {};
+        cpuid(info, 0, 0);
+        u32 maxLeaf = info[0];
+        if(maxLeaf < 1) {
+            return Isa::Scalar;
+        }
+        cpuid(info, 1, 0);
+        bool ssse3 = 0 != (info[2] & (1U << 9));
+        bool osxsave = 0 != (info[2] & (1U << 27));
+        bool avx = 0 != (info[2] & (1U << 28));
+        if(!ssse3) {
+            return Isa::Scalar;
+        }
+        // The OS has to save YMM registers too
+        if(maxLeaf < 7 || !osxsave || !avx || 0x06 != (xgetbv0() & 0x06)) {
+            return Isa::SSSE3;
+        }
+        cpuid(info, 7, 0);
+        bool avx2 = 0 != (info[1] & (1U << 5));
+        return avx2 ? Isa::AVX2 : Isa::SSSE3;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    bool isRedFirst(PixelFormat format)
+    {
+        return PixelFormat::RGB24 == format || PixelFormat::RGBA32 == format;
+    }
+
+    enum Kernel
+    {
+        Kernel_Swap24,
+        Kernel_Swap32,
+        Kernel_Pack32to24,
+        Kernel_PackSwap32to24,
+        Kernel_Expand24to32,
+        Kernel_ExpandSwap24to32,
+        Kernel_Num,
+    };
+
+    // nullptr falls back to a lower instruction set
+    const ConvertRowFunc Kernels[static_cast<u32>(Isa::Num)][Kernel_Num] = {
+        {kernel::swap24, kernel::swap32, kernel::pack32to24, kernel::packSwap32to24, kernel::expand24to32, kernel::expandSwap24to32},
+#if VCAM_X86
+        {kernel::ssse3::swap24, kernel::ssse3::swap32, kernel::ssse3::pack32to24, kernel::ssse3::packSwap32to24, kernel::ssse3::expand24to32, kernel::ssse3::expandSwap24to32},
+        {kernel::avx2::swap24, kernel::avx2::swap32, kernel::avx2::pack32to24, kernel::avx2::packSwap32to24, kernel::avx2::expand24to32, kernel::avx2::expandSwap24to32},
+#else
+        {},
+        {},
+#endif
+    };
+
+    /**
+     * @brief YUV kernels of an instruction set
+     */
+    struct YuvKernels
+    {
+        LumaRowFunc luma_;
+        ChromaRowFunc chroma_;
+        ChromaRowFunc chromaInterleaved_;
+        PackedYuvRowFunc yuy2_;
+    };
+
+    const YuvKernels YuvKernelTable[static_cast<u32>(Isa::Num)] = {
+        {kernel::luma, kernel::chroma, kernel::chromaInterleaved, kernel::yuy2},
+#if VCAM_X86
+        {kernel::ssse3::luma, kernel::ssse3::chroma, kernel::ssse3::chromaInterleaved, kernel::ssse3::yuy2},
+        {kernel::avx2::luma, kernel::avx2::chroma, kernel::avx2::chromaInterleaved, kernel::avx2::yuy2},
+#else
+        {},
+        {},
+#endif
+    };
+
+    const u32 ChunkPixels = 512; //!< Pixels per BGRA32 chunk ahead of YUV kernels, two rows of them fit in L1
+
+    u8 clamp255(s32 x)
+    {
+        return static_cast<u8>(x < 0 ? 0 : (255 < x ? 255 : x));
+    }
+
+    s16 toFixed(double x)
+    {
+        return static_cast<s16>(std::lround(x * 16384.0));
+    }
+
+    /**
+     * @brief Read a chunk of source row as BGRA32
+     */
+    const u8* toBgra(const Converter& converter, u8* temp, const u8* src, u32 width)
+    {
+        if(nullptr == converter.row_) {
+            return src;
+        }
+        converter.row_(temp, src, width);
+        return temp;
+    }
+} // namespace
+
+u32 getBytesPerPixel(PixelFormat format)
+{
+    switch(format) {
+    case PixelFormat::BGR24:
+    case PixelFormat::RGB24:
+        return 3;
+    case PixelFormat::BGRA32:
+    case PixelFormat::RGBA32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+bool isYuv(PixelFormat format)
+{
+    return PixelFormat::NV12 == format || PixelFormat::YUY2 == format || PixelFormat::I420 == format;
+}
+
+u32 getImageSize(PixelFormat format, u32 width, u32 height)
+{
+    switch(format) {
+    case PixelFormat::NV12:
+    case PixelFormat::I420:
+        return width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2);
+    case PixelFormat::YUY2:
+        return width * height * 2;
+    default:
+        return width * height * getBytesPerPixel(format);
+    }
+}
+
+u32 getRowSize(PixelFormat format, u32 width)
+{
+    switch(format) {
+    case PixelFormat::NV12:
+    case PixelFormat::I420:
+        return width;
+    case PixelFormat::YUY2:
+        return width * 2;
+    default:
+        return width * getBytesPerPixel(format);
+    }
+}
+
+Isa getCpuIsa()
+{
+    static const Isa isa = detectCpuIsa();
+    return isa;
+}
+
+const char* getIsaName(Isa isa)
+{
+    switch(isa) {
+    case Isa::Scalar:
+        return "Scalar";
+    case Isa::SSSE3:
+        return "SSSE3";
+    case Isa::AVX2:
+        return "AVX2";
+    default:
+        return "Unknown";
+    }
+}
+
+Image makeImage(const void* data, u32 width, u32 height, u32 stride, PixelFormat format, bool bottomUp)
+{
+    Image image;
+    image.data_ = reinterpret_cast<u8*>(const_cast<void*>(data));
+    image.pitch_ = stride;
+    image.width_ = width;
+    image.height_ = height;
+    image.format_ = format;
+    image.chroma_[0] = nullptr;
+    image.chroma_[1] = nullptr;
+    image.chromaPitch_ = 0;
+    switch(format) {
+    case PixelFormat::NV12:
+        image.chroma_[0] = image.data_ + static_cast<s64>(stride) * height;
+        image.chromaPitch_ = stride;
+        return image;
+    case PixelFormat::I420:
+        image.chromaPitch_ = stride / 2;
+        image.chroma_[0] = image.data_ + static_cast<s64>(stride) * height;
+        image.chroma_[1] = image.chroma_[0] + image.chromaPitch_ * ((height + 1) / 2);
+        return image;
+    case PixelFormat::YUY2:
+        return image;
+    default:
+        break;
+    }
+    if(bottomUp && 0 < height) {
+        image.data_ += static_cast<s64>(stride) * (height - 1);
+        image.pitch_ = -image.pitch_;
+    }
+    return image;
+}
+
+ConvertRowFunc selectConvertRow(PixelFormat dst, PixelFormat src, Isa isa)
+{
+    u32 dstBpp = getBytesPerPixel(dst);
+    u32 srcBpp = getBytesPerPixel(src);
+    if(0 == dstBpp || 0 == srcBpp) {
+        return nullptr;
+    }
+    bool swap = isRedFirst(dst) != isRedFirst(src);
+    if(dstBpp == srcBpp && !swap) {
+        return 3 == dstBpp ? kernel::copy24 : kernel::copy32;
+    }
+    Kernel kernel;
+    if(dstBpp == srcBpp) {
+        kernel = 3 == dstBpp ? Kernel_Swap24 : Kernel_Swap32;
+    } else if(dstBpp < srcBpp) {
+        kernel = swap ? Kernel_PackSwap32to24 : Kernel_Pack32to24;
+    } else {
+        kernel = swap ? Kernel_ExpandSwap24to32 : Kernel_Expand24to32;
+    }
+    s32 level = (std::min)(static_cast<s32>(isa), static_cast<s32>(Isa::Num) - 1);
+    for(; 0 < level && nullptr == Kernels[level][kernel]; --level) {
+    }
+    return Kernels[level][kernel];
+}
+
+void convertRows(ConvertRowFunc func, const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd)
+{
+    u8* d = dst.data_ + dst.pitch_ * rowBegin;
+    const u8* s = src.data_ + src.pitch_ * rowBegin;
+    for(u32 i = rowBegin; i < rowEnd; ++i) {
+        func(d, s, dst.width_);
+        d += dst.pitch_;
+        s += src.pitch_;
+    }
+}
+
+YuvConstants makeYuvConstants(YuvMatrix matrix, YuvRange range)
+{
+    double kr = 0.299;
+    double kb = 0.114;
+    if(YuvMatrix::BT709 == matrix) {
+        kr = 0.2126;
+        kb = 0.0722;
+    }
+    double kg = 1.0 - kr - kb;
+    bool limited = YuvRange::Limited == range;
+    double yScale = limited ? 219.0 / 255.0 : 1.0;
+    double uvScale = limited ? 224.0 / 255.0 : 1.0;
+    s32 yOffset = limited ? 16 : 0;
+
+    YuvConstants constants = {};
+    constants.y_[0] = toFixed(yScale * kb);
+    constants.y_[1] = toFixed(yScale * kg);
+    constants.y_[2] = toFixed(yScale * kr);
+    // Coefficients of U and V sum to zero, so that grays stay neutral after rounding
+    constants.u_[0] = toFixed(uvScale * 0.5);
+    constants.u_[2] = toFixed(-uvScale * 0.5 * kr / (1.0 - kb));
+    constants.u_[1] = static_cast<s16>(-constants.u_[0] - constants.u_[2]);
+    constants.v_[2] = toFixed(uvScale * 0.5);
+    constants.v_[0] = toFixed(-uvScale * 0.5 * kb / (1.0 - kr));
+    constants.v_[1] = static_cast<s16>(-constants.v_[0] - constants.v_[2]);
+    constants.yRound_ = (yOffset << 14) + (1 << 13);
+    constants.uvRound_ = (128 << 15) + (1 << 14);
+    return constants;
+}
+
+bool selectConverter(Converter& converter, PixelFormat dst, PixelFormat src, Isa isa, YuvMatrix matrix, YuvRange range)
+{
+    converter = {};
+    converter.dst_ = dst;
+    converter.src_ = src;
+    if(!isYuv(dst)) {
+        converter.row_ = selectConvertRow(dst, src, isa);
+        return nullptr != converter.row_;
+    }
+    if(0 == getBytesPerPixel(src)) {
+        return false;
+    }
+    if(PixelFormat::BGRA32 != src) {
+        converter.row_ = selectConvertRow(PixelFormat::BGRA32, src, isa);
+    }
+    s32 level = (std::min)(static_cast<s32>(isa), static_cast<s32>(Isa::Num) - 1);
+    for(; 0 < level && nullptr == YuvKernelTable[level].luma_; --level) {
+    }
+    const YuvKernels& kernels = YuvKernelTable[level];
+    converter.luma_ = kernels.luma_;
+    converter.chroma_ = PixelFormat::NV12 == dst ? kernels.chromaInterleaved_ : kernels.chroma_;
+    converter.packed_ = kernels.yuy2_;
+    converter.constants_ = makeYuvConstants(matrix, range);
+    return true;
+}
+
+void convert(const Converter& converter, const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd)
+{
+    if(!isYuv(converter.dst_)) {
+        convertRows(converter.row_, dst, src, rowBegin, rowEnd);
+        return;
+    }
+    alignas(64) u8 temp0[ChunkPixels * 4];
+    alignas(64) u8 temp1[ChunkPixels * 4];
+    u32 srcBpp = getBytesPerPixel(src.format_);
+    const YuvConstants& constants = converter.constants_;
+
+    if(PixelFormat::YUY2 == converter.dst_) {
+        for(u32 y = rowBegin; y < rowEnd; ++y) {
+            const u8* s = src.data_ + src.pitch_ * y;
+            u8* d = dst.data_ + dst.pitch_ * y;
+            for(u32 x = 0; x < dst.width_; x += ChunkPixels) {
+                u32 count = (std::min)(ChunkPixels, dst.width_ - x);
+                converter.packed_(d + x * 2, toBgra(converter, temp0, s + x * srcBpp, count), count, constants);
+            }
+        }
+        return;
+    }
+
+    // Two rows make one chroma row, the last row pairs with itself when the height is odd
+    bool interleaved = PixelFormat::NV12 == converter.dst_;
+    for(u32 y = rowBegin & ~1U; y < rowEnd; y += 2) {
+        u32 y1 = (std::min)(y + 1, dst.height_ - 1);
+        const u8* s0 = src.data_ + src.pitch_ * y;
+        const u8* s1 = src.data_ + src.pitch_ * y1;
+        u8* d0 = dst.data_ + dst.pitch_ * y;
+        u8* d1 = dst.data_ + dst.pitch_ * y1;
+        u8* u = dst.chroma_[0] + dst.chromaPitch_ * (y / 2);
+        u8* v = interleaved ? nullptr : dst.chroma_[1] + dst.chromaPitch_ * (y / 2);
+        for(u32 x = 0; x < dst.width_; x += ChunkPixels) {
+            u32 count = (std::min)(ChunkPixels, dst.width_ - x);
+            const u8* bgra0 = toBgra(converter, temp0, s0 + x * srcBpp, count);
+            const u8* bgra1 = toBgra(converter, temp1, s1 + x * srcBpp, count);
+            converter.luma_(d0 + x, bgra0, count, constants);
+            converter.luma_(d1 + x, bgra1, count, constants);
+            if(interleaved) {
+                converter.chroma_(u + x, nullptr, bgra0, bgra1, count, constants);
+            } else {
+                converter.chroma_(u + x / 2, v + x / 2, bgra0, bgra1, count, constants);
+            }
+        }
+    }
+}
+
+u32 getRowAlignment(PixelFormat format)
+{
+    return (PixelFormat::NV12 == format || PixelFormat::I420 == format) ? 2 : 1;
+}
+
+namespace kernel
+{
+    void copy24(u8* dst, const u8* src, u32 width)
+    {
+        memcpy(dst, src, width * 3);
+    }
+
+    void copy32(u8* dst, const u8* src, u32 width)
+    {
+        memcpy(dst, src, width * 4);
+    }
+
+    void swap24(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            u8 c0 = src[0];
+            u8 c1 = src[1];
+            u8 c2 = src[2];
+            dst[0] = c2;
+            dst[1] = c1;
+            dst[2] = c0;
+            dst += 3;
+            src += 3;
+        }
+    }
+
+    void swap32(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            u8 c0 = src[0];
+            u8 c2 = src[2];
+            dst[0] = c2;
+            dst[1] = src[1];
+            dst[2] = c0;
+            dst[3] = src[3];
+            dst += 4;
+            src += 4;
+        }
+    }
+
+    void pack32to24(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst += 3;
+            src += 4;
+        }
+    }
+
+    void packSwap32to24(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst += 3;
+            src += 4;
+        }
+    }
+
+    void expand24to32(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = 0xFFU;
+            dst += 4;
+            src += 3;
+        }
+    }
+
+    void expandSwap24to32(u8* dst, const u8* src, u32 width)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = 0xFFU;
+            dst += 4;
+            src += 3;
+        }
+    }
+
+    void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        for(u32 i = 0; i < width; ++i) {
+            s32 sum = constants.y_[0] * bgra[0] + constants.y_[1] * bgra[1] + constants.y_[2] * bgra[2];
+            y[i] = clamp255((sum + constants.yRound_) >> 14);
+            bgra += 4;
+        }
+    }
+
+    namespace
+    {
+        /**
+         * @brief Sums of U and V over two horizontally adjacent pixels, same rounding as _mm_avg_epu8 for the vertical average
+         */
+        void sumChroma(s32& u, s32& v, const u8* bgra0, const u8* bgra1, const YuvConstants& constants)
+        {
+            u = 0;
+            v = 0;
+            for(u32 i = 0; i < 2; ++i) {
+                s32 b = (bgra0[0] + bgra1[0] + 1) >> 1;
+                s32 g = (bgra0[1] + bgra1[1] + 1) >> 1;
+                s32 r = (bgra0[2] + bgra1[2] + 1) >> 1;
+                u += constants.u_[0] * b + constants.u_[1] * g + constants.u_[2] * r;
+                v += constants.v_[0] * b + constants.v_[1] * g + constants.v_[2] * r;
+                bgra0 += 4;
+                bgra1 += 4;
+            }
+        }
+    } // namespace
+
+    void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        for(u32 i = 0; i < width / 2; ++i) {
+            s32 sumU;
+            s32 sumV;
+            sumChroma(sumU, sumV, bgra0 + i * 8, bgra1 + i * 8, constants);
+            u[i] = clamp255((sumU + constants.uvRound_) >> 15);
+            v[i] = clamp255((sumV + constants.uvRound_) >> 15);
+        }
+    }
+
+    void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        for(u32 i = 0; i < width / 2; ++i) {
+            s32 sumU;
+            s32 sumV;
+            sumChroma(sumU, sumV, bgra0 + i * 8, bgra1 + i * 8, constants);
+            uv[i * 2 + 0] = clamp255((sumU + constants.uvRound_) >> 15);
+            uv[i * 2 + 1] = clamp255((sumV + constants.uvRound_) >> 15);
+        }
+    }
+
+    void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        for(u32 i = 0; i < width / 2; ++i) {
+            s32 sumU;
+            s32 sumV;
+            sumChroma(sumU, sumV, bgra, bgra, constants);
+            luma(dst, bgra, 1, constants);
+            luma(dst + 2, bgra + 4, 1, constants);
+            dst[1] = clamp255((sumU + constants.uvRound_) >> 15);
+            dst[3] = clamp255((sumV + constants.uvRound_) >> 15);
+            dst += 4;
+            bgra += 8;
+        }
+    }
+} // namespace kernel
+} // namespace vcam
@@ -0,0 +1,282 @@
+﻿#pragma once
+#ifndef INC_VCAM_CONVERT_H_
+#    define INC_VCAM_CONVERT_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamPlatform.h"
+namespace vcam
+{
+/**
+ * @brief Pixel layouts, named by byte order in memory
+ */
+enum class PixelFormat : u32
+{
+    Unknown = 0,
+    BGR24,  //!< B, G, R, which is MEDIASUBTYPE_RGB24
+    RGB24,  //!< R, G, B, as glReadPixels with GL_RGB
+    BGRA32, //!< B, G, R, A
+    RGBA32, //!< R, G, B, A, as glReadPixels with GL_RGBA
+    NV12,   //!< Y plane, then a plane of interleaved U and V at half resolution
+    YUY2,   //!< Y0, U, Y1, V per two pixels
+    I420,   //!< Y plane, then U and V planes at half resolution
+};
+
+/**
+ * @return Bytes per pixel of an RGB format, 0 if unknown or YUV
+ */
+u32 getBytesPerPixel(PixelFormat format);
+
+/**
+ * @brief Instruction set levels of conversion kernels
+ */
+enum class Isa : u32
+{
+    Scalar = 0,
+    SSSE3,
+    AVX2,
+    Num,
+};
+
+/**
+ * @return Whether a format is one of YUV formats
+ */
+bool isYuv(PixelFormat format);
+
+/**
+ * @brief Size of an image in bytes
+ * @param format [in] ... Pixel format
+ * @param width [in] ... Pixel width
+ * @param height [in] ... Pixel height
+ * @return Size in bytes, rows of RGB formats are packed
+ */
+u32 getImageSize(PixelFormat format, u32 width, u32 height);
+
+/**
+ * @brief Bytes of a packed row
+ * @param format [in] ... Pixel format
+ * @param width [in] ... Pixel width
+ * @return Row size in bytes, of Y plane if planar
+ */
+u32 getRowSize(PixelFormat format, u32 width);
+
+/**
+ * @return Best instruction set of this CPU, detected once
+ */
+Isa getCpuIsa();
+
+/**
+ * @return Name of an instruction set
+ */
+const char* getIsaName(Isa isa);
+
+/**
+ * @brief Description of an image
+ *
+ * Rows are addressed top to bottom. A bottom-up buffer, such as a DIB or a glReadPixels result,
+ * has data_ at its last row in memory and a negative pitch_, so a vertical flip is free in every kernel.
+ */
+struct Image
+{
+    u8* data_;           //!< Top row, of Y plane if planar
+    s64 pitch_;          //!< Bytes from a row to the one below it
+    u32 width_;          //!< Pixel width
+    u32 height_;         //!< Pixel height
+    PixelFormat format_; //!< Pixel format
+    u8* chroma_[2];      //!< Top rows of chroma planes, U and V of I420, interleaved UV of NV12 in chroma_[0]
+    s64 chromaPitch_;    //!< Bytes from a chroma row to the one below it
+};
+
+/**
+ * @brief Describe a buffer in memory
+ *
+ * Planes of NV12 and I420 follow the Y plane contiguously, YUV buffers are always top-down.
+ * @param data [in] ... First row in memory
+ * @param width [in] ... Pixel width
+ * @param height [in] ... Pixel height
+ * @param stride [in] ... Bytes per row in memory, of Y plane if planar
+ * @param format [in] ... Pixel format
+ * @param bottomUp [in] ... Whether the first row in memory is the bottom row
+ * @return Image description
+ */
+Image makeImage(const void* data, u32 width, u32 height, u32 stride, PixelFormat format, bool bottomUp);
+
+/**
+ * @brief Convert one row of pixels
+ * @param dst [out] ... Destination row
+ * @param src [in] ... Source row
+ * @param width [in] ... Pixel width
+ */
+using ConvertRowFunc = void (*)(u8* dst, const u8* src, u32 width);
+
+/**
+ * @brief Select a row kernel. Select once per format negotiation, not per frame.
+ * @param dst [in] ... Destination format
+ * @param src [in] ... Source format
+ * @param isa [in] ... Highest instruction set to use, usually getCpuIsa()
+ * @return Kernel, nullptr if the conversion is not supported
+ */
+ConvertRowFunc selectConvertRow(PixelFormat dst, PixelFormat src, Isa isa);
+
+/**
+ * @brief Convert rows between images of the same size
+ * @param func [in] ... Row kernel from selectConvertRow
+ * @param dst [out] ... Destination image
+ * @param src [in] ... Source image
+ * @param rowBegin [in] ... First row
+ * @param rowEnd [in] ... End of rows
+ */
+void convertRows(ConvertRowFunc func, const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd);
+
+/**
+ * @brief Color matrix of YUV
+ */
+enum class YuvMatrix : u32
+{
+    BT601, //!< SD
+    BT709, //!< HD
+};
+
+/**
+ * @brief Value range of YUV
+ */
+enum class YuvRange : u32
+{
+    Limited, //!< Y in 16-235, U and V in 16-240
+    Full,    //!< All in 0-255
+};
+
+/**
+ * @brief Fixed point RGB to YUV coefficients with 14 fractional bits, in B, G, R, A order of BGRA32
+ */
+struct YuvConstants
+{
+    s16 y_[4];    //!< Y coefficients
+    s16 u_[4];    //!< U coefficients
+    s16 v_[4];    //!< V coefficients
+    s32 yRound_;  //!< Offset and rounding of Y
+    s32 uvRound_; //!< Offset and rounding of U and V, which sum two pixels
+};
+
+/**
+ * @brief Compute conversion coefficients
+ * @param matrix [in] ... Color matrix
+ * @param range [in] ... Value range
+ * @return Coefficients
+ */
+YuvConstants makeYuvConstants(YuvMatrix matrix, YuvRange range);
+
+/**
+ * @brief Convert a BGRA32 row into a Y row
+ */
+using LumaRowFunc = void (*)(u8* y, const u8* bgra, u32 width, const YuvConstants& constants);
+
+/**
+ * @brief Convert two BGRA32 rows into a chroma row of half width, averaging 2x2 pixels
+ *
+ * Planar kernels write u and v, interleaved kernels write U and V pairs to u and ignore v.
+ */
+using ChromaRowFunc = void (*)(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+
+/**
+ * @brief Convert a BGRA32 row into a YUY2 row, averaging chroma of horizontal pairs
+ */
+using PackedYuvRowFunc = void (*)(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants);
+
+/**
+ * @brief Conversion of whole frames between two formats, selected once per format pair
+ *
+ * YUV destinations go through BGRA32 rows in a small stack buffer, which stays in L1 cache.
+ */
+struct Converter
+{
+    PixelFormat dst_;          //!< Destination format
+    PixelFormat src_;          //!< Source format
+    ConvertRowFunc row_;       //!< Into dst_ if RGB, else into BGRA32 or nullptr if src_ is already BGRA32
+    LumaRowFunc luma_;         //!< Y of NV12 and I420
+    ChromaRowFunc chroma_;     //!< UV of NV12 and I420
+    PackedYuvRowFunc packed_;  //!< YUY2
+    YuvConstants constants_;   //!< Coefficients of YUV destinations
+};
+
+/**
+ * @brief Select kernels of a conversion
+ * @param converter [out] ... Selected conversion
+ * @param dst [in] ... Destination format
+ * @param src [in] ... Source format, one of RGB formats
+ * @param isa [in] ... Highest instruction set to use, usually getCpuIsa()
+ * @param matrix [in] ... Color matrix of YUV destinations
+ * @param range [in] ... Value range of YUV destinations
+ * @return true if the conversion is supported
+ */
+bool selectConverter(Converter& converter, PixelFormat dst, PixelFormat src, Isa isa, YuvMatrix matrix = YuvMatrix::BT709, YuvRange range = YuvRange::Limited);
+
+/**
+ * @brief Convert rows between images of the same size
+ * @param converter [in] ... Conversion from selectConverter
+ * @param dst [out] ... Destination image
+ * @param src [in] ... Source image
+ * @param rowBegin [in] ... First row, a multiple of getRowAlignment
+ * @param rowEnd [in] ... End of rows, a multiple of getRowAlignment or the height
+ */
+void convert(const Converter& converter, const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd);
+
+/**
+ * @return Rows which a chunk of conversion into a format has to be aligned to
+ */
+u32 getRowAlignment(PixelFormat format);
+} // namespace vcam
+#endif // INC_VCAM_CONVERT_H_
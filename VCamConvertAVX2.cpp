@@ -0,0 +1,366 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamConvertKernels.h"
+#include "VCamHash.h"
+#if VCAM_X86
+#    include <cstring>
+#    include <immintrin.h>
+
+namespace vcam
+{
+namespace kernel
+{
+namespace avx2
+{
+    namespace
+    {
+        const s8 N = -128; //!< Shuffle index which writes zero
+
+        /**
+         * @brief Load 8 pixels in 24 bits, pixels 0-3 at the bottom of the low lane and 4-7 at byte 4 of the high lane
+         */
+        __m256i load24(const u8* src)
+        {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+            return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        }
+
+        /**
+         * @brief Store 24 bytes, packed by the lower 12 bytes of each lane
+         */
+        void store24(u8* dst, __m256i x)
+        {
+            x = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(x));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), _mm256_extracti128_si256(x, 1));
+        }
+
+        template<bool Swap>
+        void pack(u8* dst, const u8* src, u32 width)
+        {
+            const __m256i mask = Swap ? _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, N, N, N, N, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, N, N, N, N)
+                                      : _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, N, N, N, N, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, N, N, N, N);
+            u32 i = 0;
+            for(; (i + 8) <= width; i += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+                store24(dst, _mm256_shuffle_epi8(x, mask));
+                src += 32;
+                dst += 24;
+            }
+            if(Swap) {
+                kernel::packSwap32to24(dst, src, width - i);
+            } else {
+                kernel::pack32to24(dst, src, width - i);
+            }
+        }
+
+        template<bool Swap>
+        void expand(u8* dst, const u8* src, u32 width)
+        {
+            const __m256i mask = Swap ? _mm256_setr_epi8(2, 1, 0, N, 5, 4, 3, N, 8, 7, 6, N, 11, 10, 9, N, 6, 5, 4, N, 9, 8, 7, N, 12, 11, 10, N, 15, 14, 13, N)
+                                      : _mm256_setr_epi8(0, 1, 2, N, 3, 4, 5, N, 6, 7, 8, N, 9, 10, 11, N, 4, 5, 6, N, 7, 8, 9, N, 10, 11, 12, N, 13, 14, 15, N);
+            const __m256i alpha = _mm256_set1_epi32(static_cast<s32>(0xFF000000U));
+            u32 i = 0;
+            for(; (i + 8) <= width; i += 8) {
+                __m256i x = _mm256_shuffle_epi8(load24(src), mask);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_or_si256(x, alpha));
+                src += 24;
+                dst += 32;
+            }
+            if(Swap) {
+                kernel::expandSwap24to32(dst, src, width - i);
+            } else {
+                kernel::expand24to32(dst, src, width - i);
+            }
+        }
+
+        __m256i loadu(const u8* src)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        }
+
+        __m256i broadcast(const s16* coefficients)
+        {
+            s64 x;
+            std::memcpy(&x, coefficients, sizeof(x));
+            return _mm256_set1_epi64x(x);
+        }
+
+        /**
+         * @brief Dot products of 8 BGRA32 pixels with the coefficients, 32 bits each in pixel order
+         */
+        __m256i dot8(__m256i bgra, __m256i coefficients)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(bgra, zero), coefficients);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(bgra, zero), coefficients);
+            return _mm256_hadd_epi32(lo, hi);
+        }
+
+        /**
+         * @brief 32 luma values of 32 pixels
+         */
+        __m256i luma32(const u8* bgra, __m256i coefficients, __m256i round)
+        {
+            __m256i y0 = _mm256_srai_epi32(_mm256_add_epi32(dot8(loadu(bgra), coefficients), round), 14);
+            __m256i y1 = _mm256_srai_epi32(_mm256_add_epi32(dot8(loadu(bgra + 32), coefficients), round), 14);
+            __m256i y2 = _mm256_srai_epi32(_mm256_add_epi32(dot8(loadu(bgra + 64), coefficients), round), 14);
+            __m256i y3 = _mm256_srai_epi32(_mm256_add_epi32(dot8(loadu(bgra + 96), coefficients), round), 14);
+            // Packing works per lane, which leaves groups of 4 pixels in the order 0,2,4,6,1,3,5,7
+            __m256i y = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+            return _mm256_permutevar8x32_epi32(y, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        }
+
+        /**
+         * @brief Sums of horizontal pairs of 16 pixels of two rows, 16 bits each in pixel order
+         */
+        __m256i pairs16(__m256i p0, __m256i p1, __m256i p2, __m256i p3, __m256i coefficients, __m256i round)
+        {
+            __m256i s0 = _mm256_hadd_epi32(dot8(p0, coefficients), dot8(p1, coefficients));
+            __m256i s1 = _mm256_hadd_epi32(dot8(p2, coefficients), dot8(p3, coefficients));
+            s0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permute4x64_epi64(s0, 0xD8), round), 15);
+            s1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permute4x64_epi64(s1, 0xD8), round), 15);
+            return _mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xD8);
+        }
+
+        /**
+         * @brief 16 U in the low lane and 16 V in the high lane, from 32 pixels of two rows
+         */
+        __m256i chroma32(const u8* bgra0, const u8* bgra1, __m256i u, __m256i v, __m256i round)
+        {
+            __m256i p0 = _mm256_avg_epu8(loadu(bgra0), loadu(bgra1));
+            __m256i p1 = _mm256_avg_epu8(loadu(bgra0 + 32), loadu(bgra1 + 32));
+            __m256i p2 = _mm256_avg_epu8(loadu(bgra0 + 64), loadu(bgra1 + 64));
+            __m256i p3 = _mm256_avg_epu8(loadu(bgra0 + 96), loadu(bgra1 + 96));
+            __m256i uv = _mm256_packus_epi16(pairs16(p0, p1, p2, p3, u, round), pairs16(p0, p1, p2, p3, v, round));
+            return _mm256_permute4x64_epi64(uv, 0xD8);
+        }
+
+        /**
+         * @brief Two 14 bit weights for _mm256_madd_epi16 over pairs of 16 bit values
+         */
+        __m256i weightPair(s16 w0, s16 w1)
+        {
+            return _mm256_set1_epi32(static_cast<s32>(static_cast<u16>(w0) | (static_cast<u32>(static_cast<u16>(w1)) << 16)));
+        }
+    } // namespace
+
+    void swap24(u8* dst, const u8* src, u32 width)
+    {
+        const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, N, N, N, N, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13, N, N, N, N);
+        u32 i = 0;
+        for(; (i + 8) <= width; i += 8) {
+            store24(dst, _mm256_shuffle_epi8(load24(src), mask));
+            src += 24;
+            dst += 24;
+        }
+        kernel::swap24(dst, src, width - i);
+    }
+
+    void swap32(u8* dst, const u8* src, u32 width)
+    {
+        const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        u32 i = 0;
+        for(; (i + 16) <= width; i += 16) {
+            __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_shuffle_epi8(x0, mask));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_shuffle_epi8(x1, mask));
+            src += 64;
+            dst += 64;
+        }
+        kernel::swap32(dst, src, width - i);
+    }
+
+    void pack32to24(u8* dst, const u8* src, u32 width)
+    {
+        pack<false>(dst, src, width);
+    }
+
+    void packSwap32to24(u8* dst, const u8* src, u32 width)
+    {
+        pack<true>(dst, src, width);
+    }
+
+    void expand24to32(u8* dst, const u8* src, u32 width)
+    {
+        expand<false>(dst, src, width);
+    }
+
+    void expandSwap24to32(u8* dst, const u8* src, u32 width)
+    {
+        expand<true>(dst, src, width);
+    }
+
+    void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        const __m256i coefficients = broadcast(constants.y_);
+        const __m256i round = _mm256_set1_epi32(constants.yRound_);
+        u32 i = 0;
+        for(; (i + 32) <= width; i += 32) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), luma32(bgra + i * 4, coefficients, round));
+        }
+        ssse3::luma(y + i, bgra + i * 4, width - i, constants);
+    }
+
+    void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        const __m256i cu = broadcast(constants.u_);
+        const __m256i cv = broadcast(constants.v_);
+        const __m256i round = _mm256_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 32) <= width; i += 32) {
+            __m256i uv = chroma32(bgra0 + i * 4, bgra1 + i * 4, cu, cv, round);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i / 2), _mm256_castsi256_si128(uv));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i / 2), _mm256_extracti128_si256(uv, 1));
+        }
+        ssse3::chroma(u + i / 2, v + i / 2, bgra0 + i * 4, bgra1 + i * 4, width - i, constants);
+    }
+
+    void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        const __m256i cu = broadcast(constants.u_);
+        const __m256i cv = broadcast(constants.v_);
+        const __m256i round = _mm256_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 32) <= width; i += 32) {
+            __m256i planar = chroma32(bgra0 + i * 4, bgra1 + i * 4, cu, cv, round);
+            __m128i u = _mm256_castsi256_si128(planar);
+            __m128i v = _mm256_extracti128_si256(planar, 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + i), _mm_unpacklo_epi8(u, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + i + 16), _mm_unpackhi_epi8(u, v));
+        }
+        ssse3::chromaInterleaved(uv + i, nullptr, bgra0 + i * 4, bgra1 + i * 4, width - i, constants);
+    }
+
+    void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        const __m256i cy = broadcast(constants.y_);
+        const __m256i cu = broadcast(constants.u_);
+        const __m256i cv = broadcast(constants.v_);
+        const __m256i yRound = _mm256_set1_epi32(constants.yRound_);
+        const __m256i uvRound = _mm256_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 32) <= width; i += 32) {
+            const u8* src = bgra + i * 4;
+            __m256i y = luma32(src, cy, yRound);
+            __m256i planar = chroma32(src, src, cu, cv, uvRound);
+            __m128i u = _mm256_castsi256_si128(planar);
+            __m128i v = _mm256_extracti128_si256(planar, 1);
+            __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(u, v)), _mm_unpackhi_epi8(u, v), 1);
+            // Lanes of y and uv both hold pixels 0-15 and 16-31, so per lane interleaving stays in order
+            __m256i lo = _mm256_unpacklo_epi8(y, uv);
+            __m256i hi = _mm256_unpackhi_epi8(y, uv);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        ssse3::yuy2(dst + i * 2, bgra + i * 4, width - i, constants);
+    }
+
+    void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i round = _mm256_set1_epi32(1 << 13);
+        u32 i = begin;
+        for(; (i + 32) <= end; i += 32) {
+            __m256i sum0 = round;
+            __m256i sum1 = round;
+            __m256i sum2 = round;
+            __m256i sum3 = round;
+            for(u32 k = 0; k < taps; k += 2) {
+                bool pair = (k + 1) < taps;
+                __m256i w = weightPair(weights[k], pair ? weights[k + 1] : 0);
+                __m256i a = loadu(rows[k] + i);
+                __m256i b = loadu(rows[pair ? k + 1 : k] + i);
+                __m256i lo = _mm256_unpacklo_epi8(a, b);
+                __m256i hi = _mm256_unpackhi_epi8(a, b);
+                sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+                sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+                sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+                sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+            }
+            // Unpacking and packing both work per lane, so the bytes come back in order
+            __m256i x0 = _mm256_packs_epi32(_mm256_srai_epi32(sum0, 14), _mm256_srai_epi32(sum1, 14));
+            __m256i x1 = _mm256_packs_epi32(_mm256_srai_epi32(sum2, 14), _mm256_srai_epi32(sum3, 14));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(x0, x1));
+        }
+        ssse3::blendRows(dst, rows, weights, taps, i, end);
+    }
+
+    void hashStripes(u64* acc, const u8* data, u64 numStripes)
+    {
+        // Four lanes per register, the swap of lane pairs stays inside 128 bit halves
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc) + 1);
+        const __m256i key0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(HashKeys));
+        const __m256i key1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(HashKeys) + 1);
+        for(u64 s = 0; s < numStripes; ++s) {
+            const __m256i* stripe = reinterpret_cast<const __m256i*>(data + s * 64);
+            __m256i v0 = _mm256_loadu_si256(stripe);
+            __m256i v1 = _mm256_loadu_si256(stripe + 1);
+            __m256i k0 = _mm256_xor_si256(v0, key0);
+            __m256i k1 = _mm256_xor_si256(v1, key1);
+            __m256i p0 = _mm256_mul_epu32(k0, _mm256_shuffle_epi32(k0, _MM_SHUFFLE(2, 3, 0, 1)));
+            __m256i p1 = _mm256_mul_epu32(k1, _mm256_shuffle_epi32(k1, _MM_SHUFFLE(2, 3, 0, 1)));
+            a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(v0, _MM_SHUFFLE(1, 0, 3, 2))));
+            a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2))));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc) + 1, a1);
+    }
+} // namespace avx2
+} // namespace kernel
+} // namespace vcam
+#endif
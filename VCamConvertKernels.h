@@ -0,0 +1,130 @@
+﻿#pragma once
+#ifndef INC_VCAM_CONVERT_KERNELS_H_
+#    define INC_VCAM_CONVERT_KERNELS_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamConvert.h"
+
+#    if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#        define VCAM_X86 1
+#    else
+#        define VCAM_X86 0
+#    endif
+
+namespace vcam
+{
+/**
+ * @brief Row kernels of VCamConvert, one namespace per instruction set.
+ *
+ * Each instruction set is compiled in its own translation unit with its own code generation flags,
+ * only getCpuIsa decides which one runs. Kernel names tell channel counts and whether R and B swap.
+ */
+namespace kernel
+{
+    void copy24(u8* dst, const u8* src, u32 width);
+    void copy32(u8* dst, const u8* src, u32 width);
+    void swap24(u8* dst, const u8* src, u32 width);
+    void swap32(u8* dst, const u8* src, u32 width);
+    void pack32to24(u8* dst, const u8* src, u32 width);
+    void packSwap32to24(u8* dst, const u8* src, u32 width);
+    void expand24to32(u8* dst, const u8* src, u32 width);
+    void expandSwap24to32(u8* dst, const u8* src, u32 width);
+    void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants);
+    void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+    void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+    void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants);
+    void scaleRow(u8* dst, const u8* src, u32 width, const u32* offsets, const s16* weights, u32 taps);
+    void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end);
+    void hashStripes(u64* acc, const u8* data, u64 numStripes);
+
+#    if VCAM_X86
+    namespace ssse3
+    {
+        void swap24(u8* dst, const u8* src, u32 width);
+        void swap32(u8* dst, const u8* src, u32 width);
+        void pack32to24(u8* dst, const u8* src, u32 width);
+        void packSwap32to24(u8* dst, const u8* src, u32 width);
+        void expand24to32(u8* dst, const u8* src, u32 width);
+        void expandSwap24to32(u8* dst, const u8* src, u32 width);
+        void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants);
+        void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+        void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+        void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants);
+        void scaleRow(u8* dst, const u8* src, u32 width, const u32* offsets, const s16* weights, u32 taps);
+        void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end);
+        void hashStripes(u64* acc, const u8* data, u64 numStripes);
+    } // namespace ssse3
+
+    namespace avx2
+    {
+        void swap24(u8* dst, const u8* src, u32 width);
+        void swap32(u8* dst, const u8* src, u32 width);
+        void pack32to24(u8* dst, const u8* src, u32 width);
+        void packSwap32to24(u8* dst, const u8* src, u32 width);
+        void expand24to32(u8* dst, const u8* src, u32 width);
+        void expandSwap24to32(u8* dst, const u8* src, u32 width);
+        void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants);
+        void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+        void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants);
+        void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants);
+        void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end);
+        void hashStripes(u64* acc, const u8* data, u64 numStripes);
+    } // namespace avx2
+#    endif
+} // namespace kernel
+} // namespace vcam
+#endif // INC_VCAM_CONVERT_KERNELS_H_
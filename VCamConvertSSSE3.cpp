@@ -0,0 +1,386 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamConvertKernels.h"
+#include "VCamHash.h"
+#if VCAM_X86
+#    include <cstring>
+#    include <tmmintrin.h>
+
+namespace vcam
+{
+namespace kernel
+{
+namespace ssse3
+{
+    namespace
+    {
+        const s8 N = -128; //!< Shuffle index which writes zero
+
+        // 4 pixels in 32 bits, low 12 bytes valid
+        template<bool Swap>
+        __m128i packMask()
+        {
+            return Swap ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, N, N, N, N)
+                        : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, N, N, N, N);
+        }
+
+        // 4 pixels in 24 bits from low 12 bytes, alpha zeroed
+        template<bool Swap>
+        __m128i expandMask()
+        {
+            return Swap ? _mm_setr_epi8(2, 1, 0, N, 5, 4, 3, N, 8, 7, 6, N, 11, 10, 9, N)
+                        : _mm_setr_epi8(0, 1, 2, N, 3, 4, 5, N, 6, 7, 8, N, 9, 10, 11, N);
+        }
+
+        template<bool Swap>
+        void pack(u8* dst, const u8* src, u32 width)
+        {
+            const __m128i mask = packMask<Swap>();
+            u32 i = 0;
+            for(; (i + 16) <= width; i += 16) {
+                __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+                __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), mask);
+                __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), mask);
+                __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), mask);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+                src += 64;
+                dst += 48;
+            }
+            if(Swap) {
+                kernel::packSwap32to24(dst, src, width - i);
+            } else {
+                kernel::pack32to24(dst, src, width - i);
+            }
+        }
+
+        template<bool Swap>
+        void expand(u8* dst, const u8* src, u32 width)
+        {
+            const __m128i mask = expandMask<Swap>();
+            const __m128i alpha = _mm_set1_epi32(static_cast<s32>(0xFF000000U));
+            u32 i = 0;
+            for(; (i + 16) <= width; i += 16) {
+                __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+                __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+                __m128i p0 = x0;
+                __m128i p1 = _mm_alignr_epi8(x1, x0, 12);
+                __m128i p2 = _mm_alignr_epi8(x2, x1, 8);
+                __m128i p3 = _mm_srli_si128(x2, 4);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(p0, mask), alpha));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_shuffle_epi8(p1, mask), alpha));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_shuffle_epi8(p2, mask), alpha));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_or_si128(_mm_shuffle_epi8(p3, mask), alpha));
+                src += 48;
+                dst += 64;
+            }
+            if(Swap) {
+                kernel::expandSwap24to32(dst, src, width - i);
+            } else {
+                kernel::expand24to32(dst, src, width - i);
+            }
+        }
+
+        __m128i loadu(const u8* src)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        }
+
+        __m128i broadcast(const s16* coefficients)
+        {
+            return _mm_setr_epi16(
+                coefficients[0], coefficients[1], coefficients[2], coefficients[3],
+                coefficients[0], coefficients[1], coefficients[2], coefficients[3]);
+        }
+
+        // Dot products of 4 BGRA32 pixels with the coefficients, 32 bits each
+        __m128i dot4(__m128i bgra, __m128i coefficients)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(bgra, zero), coefficients);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(bgra, zero), coefficients);
+            return _mm_hadd_epi32(lo, hi);
+        }
+
+        // 16 luma values of 16 pixels
+        __m128i luma16(const u8* bgra, __m128i coefficients, __m128i round)
+        {
+            __m128i y0 = _mm_srai_epi32(_mm_add_epi32(dot4(loadu(bgra), coefficients), round), 14);
+            __m128i y1 = _mm_srai_epi32(_mm_add_epi32(dot4(loadu(bgra + 16), coefficients), round), 14);
+            __m128i y2 = _mm_srai_epi32(_mm_add_epi32(dot4(loadu(bgra + 32), coefficients), round), 14);
+            __m128i y3 = _mm_srai_epi32(_mm_add_epi32(dot4(loadu(bgra + 48), coefficients), round), 14);
+            return _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+        }
+
+        // 8 U in the low half and 8 V in the high half, from 16 pixels of two rows
+        __m128i chroma16(const u8* bgra0, const u8* bgra1, __m128i u, __m128i v, __m128i round)
+        {
+            __m128i sumU[2];
+            __m128i sumV[2];
+            for(u32 i = 0; i < 2; ++i) {
+                __m128i p0 = _mm_avg_epu8(loadu(bgra0 + i * 32), loadu(bgra1 + i * 32));
+                __m128i p1 = _mm_avg_epu8(loadu(bgra0 + i * 32 + 16), loadu(bgra1 + i * 32 + 16));
+                sumU[i] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(dot4(p0, u), dot4(p1, u)), round), 15);
+                sumV[i] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(dot4(p0, v), dot4(p1, v)), round), 15);
+            }
+            return _mm_packus_epi16(_mm_packs_epi32(sumU[0], sumU[1]), _mm_packs_epi32(sumV[0], sumV[1]));
+        }
+
+        // Two 14 bit weights for _mm_madd_epi16 over pairs of 16 bit values
+        __m128i weightPair(s16 w0, s16 w1)
+        {
+            return _mm_set1_epi32(static_cast<s32>(static_cast<u16>(w0) | (static_cast<u32>(static_cast<u16>(w1)) << 16)));
+        }
+    } // namespace
+
+    void swap24(u8* dst, const u8* src, u32 width)
+    {
+        // 8 pixels as three 8 byte outputs, each shuffled from a 16 byte window inside the 24 source bytes
+        const __m128i mask0 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, N, N, N, N, N, N, N, N);
+        const __m128i mask1 = _mm_setr_epi8(2, 7, 6, 5, 10, 9, 8, 13, N, N, N, N, N, N, N, N);
+        const __m128i mask2 = _mm_setr_epi8(8, 7, 12, 11, 10, 15, 14, 13, N, N, N, N, N, N, N, N);
+        u32 i = 0;
+        for(; (i + 8) <= width; i += 8) {
+            __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+            __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(x0, mask0));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 8), _mm_shuffle_epi8(x1, mask1));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), _mm_shuffle_epi8(x2, mask2));
+            src += 24;
+            dst += 24;
+        }
+        kernel::swap24(dst, src, width - i);
+    }
+
+    void swap32(u8* dst, const u8* src, u32 width)
+    {
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        u32 i = 0;
+        for(; (i + 8) <= width; i += 8) {
+            __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(x0, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_shuffle_epi8(x1, mask));
+            src += 32;
+            dst += 32;
+        }
+        kernel::swap32(dst, src, width - i);
+    }
+
+    void pack32to24(u8* dst, const u8* src, u32 width)
+    {
+        pack<false>(dst, src, width);
+    }
+
+    void packSwap32to24(u8* dst, const u8* src, u32 width)
+    {
+        pack<true>(dst, src, width);
+    }
+
+    void expand24to32(u8* dst, const u8* src, u32 width)
+    {
+        expand<false>(dst, src, width);
+    }
+
+    void expandSwap24to32(u8* dst, const u8* src, u32 width)
+    {
+        expand<true>(dst, src, width);
+    }
+
+    void luma(u8* y, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        const __m128i coefficients = broadcast(constants.y_);
+        const __m128i round = _mm_set1_epi32(constants.yRound_);
+        u32 i = 0;
+        for(; (i + 16) <= width; i += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), luma16(bgra + i * 4, coefficients, round));
+        }
+        kernel::luma(y + i, bgra + i * 4, width - i, constants);
+    }
+
+    void chroma(u8* u, u8* v, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        const __m128i cu = broadcast(constants.u_);
+        const __m128i cv = broadcast(constants.v_);
+        const __m128i round = _mm_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 16) <= width; i += 16) {
+            __m128i uv = chroma16(bgra0 + i * 4, bgra1 + i * 4, cu, cv, round);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i / 2), uv);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i / 2), _mm_srli_si128(uv, 8));
+        }
+        kernel::chroma(u + i / 2, v + i / 2, bgra0 + i * 4, bgra1 + i * 4, width - i, constants);
+    }
+
+    void chromaInterleaved(u8* uv, u8*, const u8* bgra0, const u8* bgra1, u32 width, const YuvConstants& constants)
+    {
+        const __m128i cu = broadcast(constants.u_);
+        const __m128i cv = broadcast(constants.v_);
+        const __m128i round = _mm_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 16) <= width; i += 16) {
+            __m128i planar = chroma16(bgra0 + i * 4, bgra1 + i * 4, cu, cv, round);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + i), _mm_unpacklo_epi8(planar, _mm_srli_si128(planar, 8)));
+        }
+        kernel::chromaInterleaved(uv + i, nullptr, bgra0 + i * 4, bgra1 + i * 4, width - i, constants);
+    }
+
+    void yuy2(u8* dst, const u8* bgra, u32 width, const YuvConstants& constants)
+    {
+        const __m128i cy = broadcast(constants.y_);
+        const __m128i cu = broadcast(constants.u_);
+        const __m128i cv = broadcast(constants.v_);
+        const __m128i yRound = _mm_set1_epi32(constants.yRound_);
+        const __m128i uvRound = _mm_set1_epi32(constants.uvRound_);
+        u32 i = 0;
+        for(; (i + 16) <= width; i += 16) {
+            const u8* src = bgra + i * 4;
+            __m128i y = luma16(src, cy, yRound);
+            __m128i planar = chroma16(src, src, cu, cv, uvRound);
+            __m128i uv = _mm_unpacklo_epi8(planar, _mm_srli_si128(planar, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_unpacklo_epi8(y, uv));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2 + 16), _mm_unpackhi_epi8(y, uv));
+        }
+        kernel::yuy2(dst + i * 2, bgra + i * 4, width - i, constants);
+    }
+
+    void scaleRow(u8* dst, const u8* src, u32 width, const u32* offsets, const s16* weights, u32 taps)
+    {
+        // Channels of two neighbouring pixels side by side in 16 bits, so one madd weighs both of them
+        const __m128i interleave = _mm_setr_epi8(0, N, 4, N, 1, N, 5, N, 2, N, 6, N, 3, N, 7, N);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << 13);
+        for(u32 x = 0; x < width; ++x) {
+            const u8* p = src + offsets[x] * 4;
+            const s16* w = weights + static_cast<size_t>(x) * taps;
+            __m128i sum = round;
+            u32 k = 0;
+            for(; (k + 2) <= taps; k += 2) {
+                __m128i pair = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k * 4)), interleave);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, weightPair(w[k], w[k + 1])));
+            }
+            if(k < taps) {
+                s32 pixel;
+                std::memcpy(&pixel, p + k * 4, sizeof(pixel));
+                __m128i single = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(single, weightPair(w[k], 0)));
+            }
+            sum = _mm_srai_epi32(sum, 14);
+            sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+            s32 result = _mm_cvtsi128_si32(sum);
+            std::memcpy(dst, &result, sizeof(result));
+            dst += 4;
+        }
+    }
+
+    void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << 13);
+        u32 i = begin;
+        for(; (i + 16) <= end; i += 16) {
+            __m128i sum0 = round;
+            __m128i sum1 = round;
+            __m128i sum2 = round;
+            __m128i sum3 = round;
+            for(u32 k = 0; k < taps; k += 2) {
+                // An odd last row pairs with itself at zero weight
+                bool pair = (k + 1) < taps;
+                __m128i w = weightPair(weights[k], pair ? weights[k + 1] : 0);
+                __m128i a = loadu(rows[k] + i);
+                __m128i b = loadu(rows[pair ? k + 1 : k] + i);
+                __m128i lo = _mm_unpacklo_epi8(a, b);
+                __m128i hi = _mm_unpackhi_epi8(a, b);
+                sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+                sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+                sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+                sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+            }
+            __m128i x0 = _mm_packs_epi32(_mm_srai_epi32(sum0, 14), _mm_srai_epi32(sum1, 14));
+            __m128i x1 = _mm_packs_epi32(_mm_srai_epi32(sum2, 14), _mm_srai_epi32(sum3, 14));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(x0, x1));
+        }
+        kernel::blendRows(dst, rows, weights, taps, i, end);
+    }
+
+    void hashStripes(u64* acc, const u8* data, u64 numStripes)
+    {
+        // Two lanes per register, each lane multiplies its low half by its high half
+        __m128i a[4];
+        __m128i keys[4];
+        for(u32 i = 0; i < 4; ++i) {
+            a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc) + i);
+            keys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HashKeys) + i);
+        }
+        for(u64 s = 0; s < numStripes; ++s) {
+            const __m128i* stripe = reinterpret_cast<const __m128i*>(data + s * 64);
+            for(u32 i = 0; i < 4; ++i) {
+                __m128i value = _mm_loadu_si128(stripe + i);
+                __m128i key = _mm_xor_si128(value, keys[i]);
+                __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(2, 3, 0, 1)));
+                __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+                a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+            }
+        }
+        for(u32 i = 0; i < 4; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc) + i, a[i]);
+        }
+    }
+} // namespace ssse3
+} // namespace kernel
+} // namespace vcam
+#endif
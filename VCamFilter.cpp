@@ -57,13 +57,282 @@ For more information, please refer to <http://unlicense.org>
 #include "VCamFilter.h"
 #include <Wxdebug.h>
 #include "VCamPipe.h"
+#include "VCamThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
 
 #define DECLARE_PTR(type, ptr, expr) type* ptr = (type*)(expr);
 
+namespace
+{
+    /**
+     * @return Value of environment variable VCAM_DROP_TARGET if set, otherwise JitterBuffer::DefaultDropTarget
+     */
+    double getDropTarget()
+    {
+        const char* value = std::getenv("VCAM_DROP_TARGET");
+        if(nullptr != value && '\0' != value[0]) {
+            return std::strtod(value, nullptr);
+        }
+        return vcam::JitterBuffer::DefaultDropTarget;
+    }
+
+    /**
+     * @brief Run func(rowBegin, rowEnd) over row bands on the pool, or over all rows at once without one
+     */
+    template<class T>
+    void forEachBand(vcam::ThreadPool* pool, u32 rows, u32 rowBytes, u32 alignment, T& func)
+    {
+        if(nullptr == pool) {
+            func(0U, rows);
+            return;
+        }
+        pool->parallelRows(rows, rowBytes, alignment, func);
+    }
+
+    /**
+     * @brief Copy a frame of unknown pixel format into a sample buffer as raw bytes
+     * @param dst [out] ... Sample buffer
+     * @param dstSize [in] ... Size of dst in bytes
+     * @param dstPitch [in] ... Bytes per row of dst
+     * @param view [in] ... Borrowed frame
+     * @param pool [in] ... Workers of row bands
+     */
+    void copyFrame(u8* dst, u32 dstSize, u32 dstPitch, const vcam::VCamPipe::ReadView& view, vcam::ThreadPool* pool)
+    {
+        if(dstPitch <= 0) {
+            return;
+        }
+        u32 rows = (std::min)(view.height_, dstSize / dstPitch);
+        u32 rowSize = (std::min)(dstPitch, view.pitch_);
+        auto band = [&](u32 rowBegin, u32 rowEnd) {
+            if(dstPitch == view.pitch_) {
+                memcpy(dst + dstPitch * rowBegin, view.data_ + view.pitch_ * rowBegin, dstPitch * (rowEnd - rowBegin));
+                return;
+            }
+            for(u32 i = rowBegin; i < rowEnd; ++i) {
+                memcpy(dst + dstPitch * i, view.data_ + view.pitch_ * i, rowSize);
+            }
+        };
+        forEachBand(pool, rows, rowSize * 2, 1, band);
+    }
+
+    /**
+     * @brief Convert a frame borrowed from the pipe into a sample buffer, in a single pass
+     * @param dst [out] ... Sample buffer
+     * @param dstSize [in] ... Size of dst in bytes
+     * @param bmi [in] ... Negotiated bitmap
+     * @param view [in] ... Borrowed frame
+     * @param converter [in] ... Kernels for the format of the frame, copy raw bytes if none selected
+     * @param pool [in] ... Workers of row bands
+     * @param rowBegin [in] ... First row from the top, aligned to getRowAlignment, raw copies ignore the rows
+     * @param rowEnd [in] ... End of rows from the top
+     */
+    void convertFrame(u8* dst, u32 dstSize, const BITMAPINFOHEADER& bmi, const vcam::VCamPipe::ReadView& view, const vcam::Converter& converter, vcam::ThreadPool* pool, u32 rowBegin, u32 rowEnd)
+    {
+        using namespace vcam;
+        if(!isYuv(converter.dst_)) {
+            u32 dstPitch = DIBWIDTHBYTES(bmi);
+            if(nullptr == converter.row_) {
+                copyFrame(dst, dstSize, dstPitch, view, pool);
+                return;
+            }
+            if(dstPitch <= 0) {
+                return;
+            }
+            u32 width = (std::min)(static_cast<u32>(bmi.biWidth), view.width_);
+            u32 height = (std::min)((std::min)(static_cast<u32>(bmi.biHeight), view.height_), dstSize / dstPitch);
+            rowEnd = (std::min)(rowEnd, height);
+            if(rowEnd <= rowBegin) {
+                return;
+            }
+            bool srcBottomUp = 0 == (view.flags_ & VCamPipe::FrameFlag_TopDown);
+            Image dstImage = makeImage(dst, width, height, dstPitch, PixelFormat::BGR24, true);
+            Image srcImage = makeImage(view.data_, width, height, view.pitch_, view.format_, srcBottomUp);
+            auto band = [&](u32 bandBegin, u32 bandEnd) { convertRows(converter.row_, dstImage, srcImage, rowBegin + bandBegin, rowBegin + bandEnd); };
+            forEachBand(pool, rowEnd - rowBegin, dstPitch + view.pitch_, 1, band);
+            return;
+        }
+
+        // YUV samples are top-down, and chroma planes follow the full negotiated height
+        u32 dstWidth = static_cast<u32>(bmi.biWidth);
+        u32 dstHeight = static_cast<u32>(bmi.biHeight);
+        if(nullptr == converter.luma_ || dstSize < getImageSize(converter.dst_, dstWidth, dstHeight)) {
+            return;
+        }
+        u32 width = (std::min)(dstWidth, view.width_);
+        u32 height = (std::min)(dstHeight, view.height_);
+        rowEnd = (std::min)(rowEnd, height);
+        if(rowEnd <= rowBegin) {
+            return;
+        }
+        bool srcBottomUp = 0 == (view.flags_ & VCamPipe::FrameFlag_TopDown);
+        Image dstImage = makeImage(dst, dstWidth, dstHeight, getRowSize(converter.dst_, dstWidth), converter.dst_, false);
+        dstImage.width_ = width;
+        dstImage.height_ = height;
+        Image srcImage = makeImage(view.data_, width, height, view.pitch_, view.format_, srcBottomUp);
+        auto band = [&](u32 bandBegin, u32 bandEnd) { convert(converter, dstImage, srcImage, rowBegin + bandBegin, rowBegin + bandEnd); };
+        forEachBand(pool, rowEnd - rowBegin, getRowSize(converter.dst_, width) * 2 + view.pitch_, getRowAlignment(converter.dst_), band);
+    }
+
+    /**
+     * @brief Convert only the rows of changed tiles, into a sample buffer which holds the frame before them
+     * @param tiles [in] ... Changed tiles from VCamPipe::getChangedTiles
+     * @return Number of rows converted
+     */
+    u32 convertChangedRows(u8* dst, u32 dstSize, const BITMAPINFOHEADER& bmi, const vcam::VCamPipe::ReadView& view, const vcam::Converter& converter, vcam::ThreadPool* pool, const u64* tiles)
+    {
+        using namespace vcam;
+        u32 columns = VCamPipe::getTileColumns(view.width_);
+        u32 tileRows = VCamPipe::getTileRows(view.height_);
+        u32 alignment = getRowAlignment(converter.dst_);
+        bool srcBottomUp = 0 == (view.flags_ & VCamPipe::FrameFlag_TopDown);
+        auto isChanged = [&](u32 tileRow) {
+            for(u32 x = 0; x < columns; ++x) {
+                u32 index = x + tileRow * columns;
+                if(0 != (tiles[index >> 6] & (1ULL << (index & 63)))) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        u32 converted = 0;
+        for(u32 y = 0; y < tileRows;) {
+            if(!isChanged(y)) {
+                ++y;
+                continue;
+            }
+            u32 end = y + 1;
+            while(end < tileRows && isChanged(end)) {
+                ++end;
+            }
+            // Tile rows are in memory order, converters count rows from the top
+            u32 memoryBegin = y * VCamPipe::TileSize;
+            u32 memoryEnd = (std::min)(view.height_, end * VCamPipe::TileSize);
+            u32 rowBegin = srcBottomUp ? view.height_ - memoryEnd : memoryBegin;
+            u32 rowEnd = srcBottomUp ? view.height_ - memoryBegin : memoryEnd;
+            rowBegin -= rowBegin % alignment;
+            rowEnd = (std::min)(view.height_, rowEnd + (alignment - rowEnd % alignment) % alignment);
+            convertFrame(dst, dstSize, bmi, view, converter, pool, rowBegin, rowEnd);
+            converted += rowEnd - rowBegin;
+            y = end;
+        }
+        return converted;
+    }
+
+    const u32 ScaleBandRows = 16; //!< Minimum rows per band of the scaler, each band resamples taps - 1 source rows more
+
+    /**
+     * @brief Resample a borrowed frame into a top-down BGRA32 frame of the negotiated size
+     * @param buffer [out] ... Storage of the resampled frame
+     * @param scaler [in,out] ... Resampler, tables are recomputed when sizes change
+     * @param pool [in] ... Workers of row bands
+     * @param view [in] ... Borrowed frame
+     * @param width [in] ... Negotiated width
+     * @param height [in] ... Negotiated height
+     * @return View of buffer, or view if the frame cannot be resampled
+     */
+    vcam::VCamPipe::ReadView scaleFrame(std::vector<u8>& buffer, vcam::Scaler& scaler, vcam::ThreadPool* pool, const vcam::VCamPipe::ReadView& view, u32 width, u32 height)
+    {
+        using namespace vcam;
+        if(!scaler.matches(width, height, view.width_, view.height_, view.format_)
+           && !scaler.reset(width, height, view.width_, view.height_, view.format_, ScaleFilter::Auto, getCpuIsa())) {
+            return view;
+        }
+        buffer.resize(static_cast<size_t>(width) * height * 4);
+        bool srcBottomUp = 0 == (view.flags_ & VCamPipe::FrameFlag_TopDown);
+        Image dst = makeImage(buffer.data(), width, height, width * 4, PixelFormat::BGRA32, false);
+        Image src = makeImage(view.data_, view.width_, view.height_, view.pitch_, view.format_, srcBottomUp);
+        auto band = [&](u32 rowBegin, u32 rowEnd) { scaler.scale(dst, src, rowBegin, rowEnd); };
+        forEachBand(pool, height, width * 4 + view.pitch_, ScaleBandRows, band);
+
+        VCamPipe::ReadView scaled = view;
+        scaled.data_ = buffer.data();
+        scaled.width_ = width;
+        scaled.height_ = height;
+        scaled.bpp_ = 4;
+        scaled.pitch_ = width * 4;
+        scaled.format_ = PixelFormat::BGRA32;
+        scaled.flags_ = VCamPipe::FrameFlag_TopDown;
+        return scaled;
+    }
+
+    /**
+     * @brief Subtype of an output media type
+     */
+    struct OutputType
+    {
+        vcam::PixelFormat format_;
+        DWORD compression_; //!< FOURCC, or BI_RGB
+        WORD bitCount_;
+    };
+
+    // YUV first, most consumers prefer them and they are cheaper to encode
+    const OutputType OutputTypes[] = {
+        {vcam::PixelFormat::NV12, MAKEFOURCC('N', 'V', '1', '2'), 12},
+        {vcam::PixelFormat::YUY2, MAKEFOURCC('Y', 'U', 'Y', '2'), 16},
+        {vcam::PixelFormat::I420, MAKEFOURCC('I', '4', '2', '0'), 12},
+        {vcam::PixelFormat::BGR24, BI_RGB, 24},
+    };
+    constexpr s32 NumOutputTypes = sizeof(OutputTypes) / sizeof(OutputTypes[0]);
+
+    struct Resolution
+    {
+        u32 width_;
+        u32 height_;
+        s64 minTimePerFrame_; //!< Highest frame rate
+    };
+
+    // The format table, each resolution is advertised at every frame time of FrameTimes up to its highest rate
+    const Resolution Resolutions[] = {
+        {640, 480, 83333},
+        {800, 600, 83333},
+        {1024, 768, 83333},
+        {1280, 720, 83333},
+        {1366, 768, 83333},
+        {1920, 1080, 83333},
+        {3840, 2160, 166666},
+    };
+
+    // 30, 60 and 120 fps, the first is the default
+    const s64 FrameTimes[] = {333333, 166666, 83333};
+
+    const OutputType* findOutputType(const BITMAPINFOHEADER& bmi)
+    {
+        for(const OutputType& type: OutputTypes) {
+            if(type.compression_ == bmi.biCompression && type.bitCount_ == bmi.biBitCount) {
+                return &type;
+            }
+        }
+        return nullptr;
+    }
+
+    void setVideoInfo(VIDEOINFOHEADER* pvi, const CVirtualCameraStream::Format& format, const OutputType& type)
+    {
+        ZeroMemory(pvi, sizeof(VIDEOINFOHEADER));
+        pvi->bmiHeader.biWidth = format.width_;
+        pvi->bmiHeader.biHeight = format.height_;
+        pvi->AvgTimePerFrame = format.timePerFrame_;
+        pvi->bmiHeader.biCompression = type.compression_;
+        pvi->bmiHeader.biBitCount = type.bitCount_;
+        pvi->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        pvi->bmiHeader.biPlanes = 1;
+        pvi->bmiHeader.biSizeImage = vcam::isYuv(type.format_) ? vcam::getImageSize(type.format_, format.width_, format.height_) : GetBitmapSize(&pvi->bmiHeader);
+        pvi->bmiHeader.biClrImportant = 0;
+        u64 bitRate = static_cast<u64>(pvi->bmiHeader.biSizeImage) * 8 * (10000000 / format.timePerFrame_);
+        pvi->dwBitRate = static_cast<DWORD>((std::min)(bitRate, static_cast<u64>(MAXDWORD)));
+
+        SetRectEmpty(&(pvi->rcSource));
+        SetRectEmpty(&(pvi->rcTarget));
+    }
+}
+
 //--- CVirtualCamera
 //------------------------------------------------------
-CVirtualCamera::CVirtualCamera(LPUNKNOWN unknown, HRESULT* result, const GUID guid)
+CVirtualCamera::CVirtualCamera(LPUNKNOWN unknown, HRESULT* result, const GUID guid, u32 channel)
     : CSource(NAME("VCam Virtual Cam"), unknown, guid)
+    , channel_(channel)
 {
     VCAM_ASSERT(nullptr != result);
     CAutoLock cAutoLock(&m_cStateLock);
@@ -71,15 +340,19 @@ CVirtualCamera::CVirtualCamera(LPUNKNOWN unknown, HRESULT* result, const GUID gu
     m_paStreams[0] = new CVirtualCameraStream(result, this, L"VCam Virtual Cam");
 }
 
-CUnknown* WINAPI CVirtualCamera::CreateInstance(LPUNKNOWN lpunk, HRESULT* phr)
+CUnknown* CVirtualCamera::CreateInstance(LPUNKNOWN lpunk, HRESULT* phr, u32 channel)
 {
     VCAM_ASSERT(nullptr != phr);
-	return new CVirtualCamera(lpunk, phr, CLSID_VCAM_VirtualCam);
+    // Each channel is a camera of its own class
+    const GUID* Clsids[] = {&CLSID_VCAM_VirtualCam, &CLSID_VCAM_VirtualCam2, &CLSID_VCAM_VirtualCam3, &CLSID_VCAM_VirtualCam4};
+    static_assert(sizeof(Clsids) / sizeof(Clsids[0]) == vcam::VCamPipe::MaxChannels, "A class per channel");
+    VCAM_ASSERT(channel < vcam::VCamPipe::MaxChannels);
+	return new CVirtualCamera(lpunk, phr, *Clsids[channel], channel);
 }
 
 STDMETHODIMP CVirtualCamera::QueryInterface(REFIID riid, void** ppv)
 {
-    if(riid == _uuidof(IAMStreamConfig) || riid == _uuidof(IKsPropertySet)) {
+    if(riid == _uuidof(IAMStreamConfig) || riid == _uuidof(IKsPropertySet) || riid == _uuidof(IAMDroppedFrames)) {
         return m_paStreams[0]->QueryInterface(riid, ppv);
     } else {
         return CSource::NonDelegatingQueryInterface(riid, ppv);
@@ -91,26 +364,17 @@ STDMETHODIMP CVirtualCamera::QueryInterface(REFIID riid, void** ppv)
 CVirtualCameraStream::CVirtualCameraStream(HRESULT* result, CVirtualCamera* parent, LPCWSTR pinName)
     : CSourceStream(NAME("VCam Virtual Cam"), result, parent, pinName)
     , parent_(parent)
+    , formats_(getFormats())
 {
-    formats_[0] = {640, 480, 333333};
-    formats_[1] = {800, 600, 333333};
-    formats_[2] = {1024, 768, 333333};
-    formats_[3] = {1280, 720, 333333};
-    formats_[4] = {1366, 768, 333333};
-    formats_[5] = {1920, 1080, 333333};
-    //formats_[6] = {3840, 2160, 333333};
+    // Applications create the filter to read caps, the pipe waits for streaming
     GetMediaType(0, &m_mt);
-    pipe_ = new vcam::VCamPipe;
-    const Format& format = formats_[MAX_FORMATS - 1];
-    u32 sizePerFrame = format.width_ * format.height_ * 3;
-    if(!pipe_->openRead(format.width_, format.height_, 3, 4, sizePerFrame)) {
-        delete pipe_;
-        pipe_ = nullptr;
-    }
+    jitter_.setDropTarget(getDropTarget());
 }
 
 CVirtualCameraStream::~CVirtualCameraStream()
 {
+    delete pool_;
+    pool_ = nullptr;
     delete pipe_;
     pipe_ = nullptr;
 }
@@ -121,6 +385,8 @@ HRESULT CVirtualCameraStream::QueryInterface(REFIID riid, void** ppv)
         *ppv = (IAMStreamConfig*)this;
     } else if(riid == _uuidof(IKsPropertySet)) {
         *ppv = (IKsPropertySet*)this;
+    } else if(riid == _uuidof(IAMDroppedFrames)) {
+        *ppv = (IAMDroppedFrames*)this;
     } else {
         return CSourceStream::QueryInterface(riid, ppv);
     }
@@ -149,83 +415,242 @@ HRESULT CVirtualCameraStream::FillBuffer(IMediaSample* pms)
 
     BYTE *pData;
 	pms->GetPointer(&pData);
-    u32 width = 0;
-    u32 height = 0;
-    u32 bpp = 0;
     u32 dstSize = pms->GetSize();
+    VIDEOINFOHEADER* pvi = (VIDEOINFOHEADER*)m_mt.pbFormat;
 
-    REFERENCE_TIME avgTimePerFrame = ((VIDEOINFOHEADER*)m_mt.pbFormat)->AvgTimePerFrame;
+    REFERENCE_TIME avgTimePerFrame = pvi->AvgTimePerFrame;
     REFERENCE_TIME currentTime = prevEndTimestamp_;
-    prevEndTimestamp_ += avgTimePerFrame;
     if(nullptr != pipe_) {
-        VCamPipe::Status status = pipe_->pop(pData, dstSize, width, height, bpp, lastSyncTime_, currentTime, syncTimeout);
+        // Sleep until the sample is due, the renderer does not pace a live source
+        u64 interval = static_cast<u64>(avgTimePerFrame) * 100;
+        if(!pacer_.isStarted() || interval != pacer_.getInterval()) {
+            pacer_.start(interval);
+            jitter_.setReadInterval(interval);
+        }
+        u32 missed = pacer_.getMissed();
+        u64 deadline = pacer_.wait();
+        u64 fillStartTime = getMonotonicTime();
+
+        // Read straight out of shared memory, the slot stays pinned until release
+        VCamPipe::ReadView view;
+        VCamPipe::Status status = pipe_->peekRead(view, lastSyncTime_, currentTime, syncTimeout, deadline);
+        // The ring grows with reserve or a larger frame, the queue leaves the writer two slots of it
+        u32 maxFrames = pipe_->getMaxFrames();
+        if(maxFrames != ringFrames_) {
+            ringFrames_ = maxFrames;
+            jitter_.setMaxDepth(2 < maxFrames ? maxFrames - 2 : 0);
+        }
+        // release clears the view
+        u32 sequence = view.sequence_;
+        u64 frameNumber = view.frameNumber_;
+        u64 captureTime = view.timestamp_;
+        // A duplicate of the last frame is repeated, but it is still a new frame in time
+        bool isNewFrame = VCamPipe::Status::Success == status || 0 != (view.flags_ & VCamPipe::FrameFlag_Duplicate);
+        if(VCamPipe::Status::Success == status || VCamPipe::Status::RepeatLastFrame == status) {
+            fillSample(pData, dstSize, pvi->bmiHeader, view, status);
+            pipe_->release(view);
+        }
+        // Without a reference clock, samples are stamped with their deadlines from the stream start
+        REFERENCE_TIME startTime = (std::max)(static_cast<REFERENCE_TIME>((deadline - pacer_.getOrigin()) / 100), prevEndTimestamp_);
+        CRefTime streamTime;
+        if(SUCCEEDED(parent_->StreamTime(streamTime))) {
+            // Both clocks run in real time, so a frame was captured its age before the current stream time
+            u64 now = getMonotonicTime();
+            REFERENCE_TIME age = 0;
+            if(isNewFrame && captureTime < now) {
+                age = static_cast<REFERENCE_TIME>((now - captureTime) / 100);
+            }
+            startTime = (std::max)(streamTime.m_time - age, prevEndTimestamp_);
+        }
+        prevEndTimestamp_ = startTime + avgTimePerFrame;
+
+        if(isNewFrame) {
+            jitter_.addFrame(sequence, captureTime);
+            pipe_->setTargetDepth(jitter_.getTargetDepth());
+        }
+
         switch(status){
         case VCamPipe::Status::Success:
             lastSyncTime_ = currentTime;
             pms->SetSyncPoint(TRUE);
+            countFrame(pms, frameNumber);
             break;
         case VCamPipe::Status::RepeatLastFrame:
             pms->SetSyncPoint(FALSE);
+            if(isNewFrame) {
+                countFrame(pms, frameNumber);
+            }
             break;
         case VCamPipe::Status::SyncTimeout:
             pms->SetSyncPoint(FALSE);
             break;
         }
-        pms->SetTime(&currentTime, &prevEndTimestamp_);
+        pms->SetTime(&startTime, &prevEndTimestamp_);
+
+        PipeStats* stats = pipe_->getStats();
+        addSharedCounter(stats->delivered_);
+        addSharedCounter(stats->lateSamples_, pacer_.getMissed() - missed);
+        stats->fillTime_.recordShared(getMonotonicTime() - fillStartTime);
     }
 	return NOERROR;
 }
 
+void CVirtualCameraStream::fillSample(u8* dst, u32 dstSize, const BITMAPINFOHEADER& bmi, const vcam::VCamPipe::ReadView& view, vcam::VCamPipe::Status status)
+{
+    using namespace vcam;
+    if(VCamPipe::Status::Success == status) {
+        ++content_;
+    }
+    SampleBuffer* held = nullptr;
+    for(SampleBuffer& sampleBuffer: sampleBuffers_) {
+        if(dst == sampleBuffer.buffer_) {
+            held = &sampleBuffer;
+            break;
+        }
+    }
+    if(nullptr == held) {
+        // An unknown buffer holds nothing usable
+        held = &sampleBuffers_[nextSampleBuffer_];
+        nextSampleBuffer_ = (nextSampleBuffer_ + 1) % MAX_SAMPLE_BUFFERS;
+        *held = {};
+    }
+    PipeStats* stats = pipe_->getStats();
+    bool isValid = dst == held->buffer_ && generation_ == held->generation_;
+    if(isValid && content_ == held->content_) {
+        // Repeats and duplicates leave the buffer as it is
+        held->sequence_ = view.sequence_;
+        addSharedCounter(stats->samplesReused_);
+        return;
+    }
+
+    // A producer of another size is resampled, then converted like any other frame
+    VCamPipe::ReadView source = view;
+    u32 width = static_cast<u32>(bmi.biWidth);
+    u32 height = static_cast<u32>(bmi.biHeight);
+    bool isScaled = view.width_ != width || view.height_ != height;
+    if(isScaled) {
+        source = scaleFrame(scaled_, scaler_, pool_, view, width, height);
+    }
+    if(source.format_ != converter_.src_ || outputFormat_ != converter_.dst_) {
+        // Kernels are selected once per producer format, not per frame
+        YuvMatrix matrix = bmi.biHeight < 720 ? YuvMatrix::BT601 : YuvMatrix::BT709;
+        selectConverter(converter_, outputFormat_, source.format_, getCpuIsa(), matrix, YuvRange::Limited);
+        ++generation_;
+        isValid = false;
+    }
+    u64 tiles[VCamPipe::TileWords];
+    bool hasConverter = nullptr != converter_.row_ || nullptr != converter_.luma_;
+    if(isValid && !isScaled && hasConverter && pipe_->getChangedTiles(tiles, view, held->sequence_)) {
+        // The buffer holds an older frame of the ring, only rows of changed tiles differ
+        u32 converted = convertChangedRows(dst, dstSize, bmi, view, converter_, pool_, tiles);
+        addSharedCounter(stats->samplesPatched_);
+        addSharedCounter(stats->rowsSkipped_, height - (std::min)(converted, height));
+    } else {
+        convertFrame(dst, dstSize, bmi, source, converter_, pool_, 0, height);
+    }
+    held->buffer_ = dst;
+    held->generation_ = generation_;
+    held->sequence_ = view.sequence_;
+    held->content_ = content_;
+}
+
+void CVirtualCameraStream::countFrame(IMediaSample* pms, u64 frameNumber)
+{
+    CAutoLock lock(&droppedLock_);
+    u32 overflows = pipe_->getOverflowedFrames();
+    if(hasFrameNumber_ && nextFrameNumber_ < frameNumber) {
+        // Frames skipped for a newer one under ReadPolicy::Latest or Buffered are by choice,
+        // only the oldest ones of the gap, which the producer dropped from this reader because the ring was full, are drops
+        // A reader which rejoins after being declared stale counts from zero again
+        u32 numOverflowed = overflows < lastOverflows_ ? overflows : overflows - lastOverflows_;
+        u64 numDropped = (std::min)(frameNumber - nextFrameNumber_, static_cast<u64>(numOverflowed));
+        if(0 < numDropped) {
+            u64 end = nextFrameNumber_ + numDropped;
+            for(u64 i = end - (std::min)(numDropped, static_cast<u64>(MAX_DROPPED_INFO)); i < end; ++i) {
+                u64 index = static_cast<u64>(numDropped_) + (i - nextFrameNumber_);
+                droppedInfo_[index % MAX_DROPPED_INFO] = static_cast<long>(i);
+            }
+            numDropped_ += static_cast<long>(numDropped);
+            vcam::addSharedCounter(pipe_->getStats()->dropped_, static_cast<u32>(numDropped));
+            pms->SetDiscontinuity(TRUE);
+        }
+    }
+    lastOverflows_ = overflows;
+    // A restarted producer counts from zero again, which is not a drop
+    hasFrameNumber_ = true;
+    nextFrameNumber_ = frameNumber + 1;
+    ++numNotDropped_;
+
+    LONGLONG mediaStart = static_cast<LONGLONG>(frameNumber);
+    LONGLONG mediaEnd = mediaStart + 1;
+    pms->SetMediaTime(&mediaStart, &mediaEnd);
+}
+
 HRESULT CVirtualCameraStream::SetMediaType(const CMediaType* pmt)
 {
     DECLARE_PTR(VIDEOINFOHEADER, pvi, pmt->Format());
     HRESULT hr = CSourceStream::SetMediaType(pmt);
 
     syncTimeout = 10 * ((VIDEOINFOHEADER*)m_mt.pbFormat)->AvgTimePerFrame;
+    const OutputType* type = findOutputType(pvi->bmiHeader);
+    outputFormat_ = nullptr != type ? type->format_ : vcam::PixelFormat::BGR24;
+    converter_ = {};
+    ++generation_;
 
+    // Producers push RGB, YUV samples are converted in FillBuffer
     u32 width = pvi->bmiHeader.biWidth;
     u32 height = pvi->bmiHeader.biHeight;
-    u32 bpp = pvi->bmiHeader.biBitCount / 8;
+    u32 bpp = vcam::isYuv(outputFormat_) ? 3 : pvi->bmiHeader.biBitCount / 8;
+    // Before streaming the format only takes effect in openPipe
     if(nullptr != pipe_) {
         if(!pipe_->checkFormat(width, height, bpp)) {
             pipe_->setFormat(width, height, bpp);
         }
-    } else {
-        pipe_ = new vcam::VCamPipe;
-        const Format& format = formats_[MAX_FORMATS-1];
-        u32 sizePerFrame = format.width_*format.height_*3;
-        if (!pipe_->openRead(width, height, bpp, 4, sizePerFrame)) {
-            delete pipe_;
-            pipe_ = nullptr;
-        }
+        pipe_->reserve(getRingFrames(pvi->AvgTimePerFrame), width * height * bpp);
     }
     return hr;
 }
 
+void CVirtualCameraStream::openPipe()
+{
+    if(nullptr != pipe_) {
+        return;
+    }
+    const VIDEOINFOHEADER* pvi = (const VIDEOINFOHEADER*)m_mt.Format();
+    u32 width = pvi->bmiHeader.biWidth;
+    u32 height = pvi->bmiHeader.biHeight;
+    u32 bpp = vcam::isYuv(outputFormat_) ? 3 : pvi->bmiHeader.biBitCount / 8;
+    // The ring fits the negotiated format, it grows when a larger one is negotiated or pushed
+    pipe_ = new vcam::VCamPipe;
+    if(!pipe_->openRead(width, height, bpp, getRingFrames(pvi->AvgTimePerFrame), width * height * bpp, parent_->GetChannel())) {
+        delete pipe_;
+        pipe_ = nullptr;
+    } else {
+        // A camera shows the newest frame, queued only as deep as the producer's jitter needs
+        pipe_->setReadPolicy(vcam::VCamPipe::ReadPolicy::Buffered);
+    }
+}
+
 HRESULT CVirtualCameraStream::GetMediaType(int iPosition, CMediaType* pmt)
 {
     if(iPosition < 0) {
         return E_INVALIDARG;
     }
-    if (static_cast<s32>(formats_.size()) <= iPosition) {
+    // The format chosen by SetFormat is the only one, so a reconnection keeps it
+    if(hasFormat_) {
+        if(0 < iPosition) {
+            return VFW_S_NO_MORE_ITEMS;
+        }
+        *pmt = m_mt;
+        return NOERROR;
+    }
+    const s32 numFormats = static_cast<s32>(formats_.size());
+    if (NumOutputTypes * numFormats <= iPosition) {
         return VFW_S_NO_MORE_ITEMS;
     }
 
     DECLARE_PTR(VIDEOINFOHEADER, pvi, pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER)));
-    ZeroMemory(pvi, sizeof(VIDEOINFOHEADER));
-
-    pvi->bmiHeader.biWidth = formats_[iPosition].width_;
-    pvi->bmiHeader.biHeight = formats_[iPosition].height_;
-    pvi->AvgTimePerFrame = formats_[iPosition].timePerFrame_;
-    pvi->bmiHeader.biCompression = BI_RGB;
-    pvi->bmiHeader.biBitCount = 24;
-    pvi->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    pvi->bmiHeader.biPlanes = 1;
-    pvi->bmiHeader.biSizeImage = GetBitmapSize(&pvi->bmiHeader);
-    pvi->bmiHeader.biClrImportant = 0;
-
-    SetRectEmpty(&(pvi->rcSource));
-    SetRectEmpty(&(pvi->rcTarget));
+    setVideoInfo(pvi, formats_[iPosition % numFormats], OutputTypes[iPosition / numFormats]);
 
     const GUID Subtype = GetBitmapSubtype(&pvi->bmiHeader);
 
@@ -239,10 +664,56 @@ HRESULT CVirtualCameraStream::GetMediaType(int iPosition, CMediaType* pmt)
 
 HRESULT CVirtualCameraStream::CheckMediaType(const CMediaType* pMediaType)
 {
-    if(nullptr == pMediaType) {
+    if(nullptr == pMediaType || nullptr == pMediaType->Format()) {
         return E_FAIL;
     }
-    return *pMediaType != m_mt? E_INVALIDARG : S_OK;
+    if(hasFormat_) {
+        return *pMediaType == m_mt ? S_OK : E_INVALIDARG;
+    }
+    return checkAdvertised(pMediaType);
+}
+
+HRESULT CVirtualCameraStream::checkAdvertised(const CMediaType* pMediaType)
+{
+    if(*pMediaType->Type() != MEDIATYPE_Video || *pMediaType->FormatType() != FORMAT_VideoInfo || pMediaType->FormatLength() < sizeof(VIDEOINFOHEADER)) {
+        return E_INVALIDARG;
+    }
+    const VIDEOINFOHEADER* pvi = (const VIDEOINFOHEADER*)pMediaType->Format();
+    if(nullptr == findOutputType(pvi->bmiHeader) || *pMediaType->Subtype() != GetBitmapSubtype(&pvi->bmiHeader)) {
+        return E_INVALIDARG;
+    }
+    for(const Format& format: formats_) {
+        if(static_cast<LONG>(format.width_) == pvi->bmiHeader.biWidth
+           && static_cast<LONG>(format.height_) == pvi->bmiHeader.biHeight
+           && format.minTimePerFrame_ <= pvi->AvgTimePerFrame && pvi->AvgTimePerFrame <= MAX_FRAMETIME) {
+            return S_OK;
+        }
+    }
+    return E_INVALIDARG;
+}
+
+const std::vector<CVirtualCameraStream::Format>& CVirtualCameraStream::getFormats()
+{
+    static const std::vector<Format> formats = [] {
+        std::vector<Format> formats;
+        for(const Resolution& resolution: Resolutions) {
+            VCAM_ASSERT(MIN_FRAMETIME <= resolution.minTimePerFrame_);
+            for(s64 timePerFrame: FrameTimes) {
+                if(resolution.minTimePerFrame_ <= timePerFrame) {
+                    formats.push_back({resolution.width_, resolution.height_, timePerFrame, resolution.minTimePerFrame_});
+                }
+            }
+        }
+        return formats;
+    }();
+    return formats;
+}
+
+u32 CVirtualCameraStream::getRingFrames(s64 timePerFrame)
+{
+    // Faster producers get more slots, so a late read still finds the frames it has missed
+    s64 frames = 0 < timePerFrame ? (RING_DURATION + timePerFrame - 1) / timePerFrame : MAX_RING_FRAMES;
+    return static_cast<u32>((std::min)((std::max)(frames, static_cast<s64>(MIN_RING_FRAMES)), static_cast<s64>(MAX_RING_FRAMES)));
 }
 
 HRESULT CVirtualCameraStream::DecideBufferSize(IMemAllocator* pAlloc, ALLOCATOR_PROPERTIES* pProperties)
@@ -251,7 +722,9 @@ HRESULT CVirtualCameraStream::DecideBufferSize(IMemAllocator* pAlloc, ALLOCATOR_
     HRESULT hr = NOERROR;
 
     VIDEOINFOHEADER* pvi = (VIDEOINFOHEADER*)m_mt.Format();
-    pProperties->cBuffers = 1;
+    // At high frame rates a renderer holds more samples, one per SAMPLE_DURATION keeps FillBuffer from blocking on them
+    s64 numBuffers = 0 < pvi->AvgTimePerFrame ? SAMPLE_DURATION / pvi->AvgTimePerFrame : 1;
+    pProperties->cBuffers = static_cast<long>((std::min)((std::max)(numBuffers, static_cast<s64>(1)), static_cast<s64>(MAX_SAMPLE_BUFFERS)));
     pProperties->cbBuffer = pvi->bmiHeader.biSizeImage;
 
     ALLOCATOR_PROPERTIES Actual;
@@ -269,11 +742,32 @@ HRESULT CVirtualCameraStream::DecideBufferSize(IMemAllocator* pAlloc, ALLOCATOR_
 HRESULT CVirtualCameraStream::OnThreadCreate()
 {
     prevEndTimestamp_ = 0;
+    ringFrames_ = 0;
+    {
+        CAutoLock lock(&droppedLock_);
+        hasFrameNumber_ = false;
+        numDropped_ = 0;
+        numNotDropped_ = 0;
+    }
+    // A new allocator may hand out buffers at the same addresses
+    ++generation_;
+    pacer_.stop();
+    jitter_.reset();
+    if(nullptr == pool_) {
+        pool_ = new vcam::ThreadPool(vcam::ThreadPool::getDefaultNumWorkers());
+    }
+    openPipe();
     return NOERROR;
 }
 
 HRESULT CVirtualCameraStream::OnThreadDestroy()
 {
+    // Workers must not outlive streaming, joining them at DLL unload would deadlock on the loader lock
+    delete pool_;
+    pool_ = nullptr;
+    // The cursor goes with streaming, so the writer does not keep frames for a stopped camera
+    delete pipe_;
+    pipe_ = nullptr;
     return NOERROR;
 }
 
@@ -285,11 +779,14 @@ HRESULT STDMETHODCALLTYPE CVirtualCameraStream::SetFormat(AM_MEDIA_TYPE* pmt)
     if (State_Stopped != parent_->GetState()) {
         return E_FAIL;
     }
-    if (S_OK != CheckMediaType(static_cast<const CMediaType*>(pmt))) {
+    // Any advertised format may replace the one chosen before
+    const CMediaType* mediaType = static_cast<const CMediaType*>(pmt);
+    if (nullptr == mediaType->Format() || S_OK != checkAdvertised(mediaType)) {
         return E_FAIL;
     }
 
     m_mt = *pmt;
+    hasFormat_ = true;
     IPin* pin = nullptr;
     ConnectedTo(&pin);
     if(nullptr != pin) {
@@ -307,35 +804,24 @@ HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetFormat(AM_MEDIA_TYPE** ppmt)
 
 HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetNumberOfCapabilities(int* piCount, int* piSize)
 {
-    *piCount = static_cast<s32>(formats_.size());
+    *piCount = NumOutputTypes * static_cast<s32>(formats_.size());
     *piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS);
     return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetStreamCaps(int iIndex, AM_MEDIA_TYPE** pmt, BYTE* pSCC)
 {
-    if (iIndex < 0 || static_cast<s32>(formats_.size()) <= iIndex) {
+    const s32 numFormats = static_cast<s32>(formats_.size());
+    if (iIndex < 0 || NumOutputTypes * numFormats <= iIndex) {
         return E_INVALIDARG;
     }
 
     *pmt = CreateMediaType(&m_mt);
     DECLARE_PTR(VIDEOINFOHEADER, pvi, (*pmt)->pbFormat);
-
-    pvi->bmiHeader.biWidth = formats_[iIndex].width_;
-    pvi->bmiHeader.biHeight = formats_[iIndex].height_;
-    pvi->AvgTimePerFrame = formats_[iIndex].timePerFrame_;
-    pvi->bmiHeader.biCompression = BI_RGB;
-    pvi->bmiHeader.biBitCount = 24;
-    pvi->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    pvi->bmiHeader.biPlanes = 1;
-    pvi->bmiHeader.biSizeImage = GetBitmapSize(&pvi->bmiHeader);
-    pvi->bmiHeader.biClrImportant = 0;
-
-    SetRectEmpty(&(pvi->rcSource));
-    SetRectEmpty(&(pvi->rcTarget));
+    setVideoInfo(pvi, formats_[iIndex % numFormats], OutputTypes[iIndex / numFormats]);
 
     (*pmt)->majortype = MEDIATYPE_Video;
-    (*pmt)->subtype = MEDIASUBTYPE_RGB24;
+    (*pmt)->subtype = GetBitmapSubtype(&pvi->bmiHeader);
     (*pmt)->formattype = FORMAT_VideoInfo;
     (*pmt)->bTemporalCompression = FALSE;
     (*pmt)->bFixedSizeSamples = FALSE;
@@ -367,10 +853,13 @@ HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetStreamCaps(int iIndex, AM_MED
     pvscc->StretchTapsY = 0;
     pvscc->ShrinkTapsX = 0;
     pvscc->ShrinkTapsY = 0;
-    pvscc->MinFrameInterval = pvi->AvgTimePerFrame;
-    pvscc->MaxFrameInterval = pvi->AvgTimePerFrame;
-    pvscc->MinBitsPerSecond = static_cast<LONG>(pvi->bmiHeader.biWidth * pvi->bmiHeader.biHeight * 3 * 8 * (10000000 / pvi->AvgTimePerFrame));
-    pvscc->MaxBitsPerSecond = static_cast<LONG>(pvi->bmiHeader.biWidth * pvi->bmiHeader.biHeight * 3 * 8 * (10000000 / pvi->AvgTimePerFrame));
+    // SetFormat takes any frame time in between
+    const Format& format = formats_[iIndex % numFormats];
+    u64 bitsPerFrame = static_cast<u64>(pvi->bmiHeader.biSizeImage) * 8;
+    pvscc->MinFrameInterval = format.minTimePerFrame_;
+    pvscc->MaxFrameInterval = MAX_FRAMETIME;
+    pvscc->MinBitsPerSecond = static_cast<LONG>((std::min)(bitsPerFrame * 10000000 / MAX_FRAMETIME, static_cast<u64>(MAXLONG)));
+    pvscc->MaxBitsPerSecond = static_cast<LONG>((std::min)(bitsPerFrame * 10000000 / static_cast<u64>(format.minTimePerFrame_), static_cast<u64>(MAXLONG)));
     return S_OK;
 }
 
@@ -419,3 +908,53 @@ HRESULT CVirtualCameraStream::QuerySupported(REFGUID guidPropSet, DWORD dwPropID
     return S_OK;
 }
 
+
+HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetNumDropped(long* plDropped)
+{
+    if(nullptr == plDropped) {
+        return E_POINTER;
+    }
+    CAutoLock lock(&droppedLock_);
+    *plDropped = numDropped_;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetNumNotDropped(long* plNotDropped)
+{
+    if(nullptr == plNotDropped) {
+        return E_POINTER;
+    }
+    CAutoLock lock(&droppedLock_);
+    *plNotDropped = numNotDropped_;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetDroppedInfo(long lSize, long* plArray, long* plNumCopied)
+{
+    if(nullptr == plArray || nullptr == plNumCopied) {
+        return E_POINTER;
+    }
+    if(lSize <= 0) {
+        return E_INVALIDARG;
+    }
+    CAutoLock lock(&droppedLock_);
+    // Only the latest MAX_DROPPED_INFO numbers are kept, oldest first
+    long numKept = (std::min)(numDropped_, static_cast<long>(MAX_DROPPED_INFO));
+    std::array<long, MAX_DROPPED_INFO> kept;
+    std::copy(droppedInfo_.begin(), droppedInfo_.begin() + numKept, kept.begin());
+    std::sort(kept.begin(), kept.begin() + numKept);
+    long numCopied = (std::min)(numKept, lSize);
+    std::copy(kept.begin(), kept.begin() + numCopied, plArray);
+    *plNumCopied = numCopied;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE CVirtualCameraStream::GetAverageFrameSize(long* plAverageSize)
+{
+    if(nullptr == plAverageSize) {
+        return E_POINTER;
+    }
+    const VIDEOINFOHEADER* pvi = (const VIDEOINFOHEADER*)m_mt.Format();
+    *plAverageSize = nullptr != pvi ? static_cast<long>(pvi->bmiHeader.biSizeImage) : 0;
+    return S_OK;
+}
@@ -62,6 +62,12 @@ For more information, please refer to <http://unlicense.org>
 #    include <cassert>
 #    include <cstdint>
 #    include <streams.h>
+#    include <vector>
+#    include "VCamConvert.h"
+#    include "VCamJitter.h"
+#    include "VCamPacer.h"
+#    include "VCamPipe.h"
+#    include "VCamScale.h"
 
 #    define VCAM_ASSERT(exp) assert(exp)
 
@@ -74,10 +80,13 @@ using u64 = uint64_t;
 using f32 = float;
 
 extern const GUID CLSID_VCAM_VirtualCam;
+extern const GUID CLSID_VCAM_VirtualCam2;
+extern const GUID CLSID_VCAM_VirtualCam3;
+extern const GUID CLSID_VCAM_VirtualCam4;
 
 namespace vcam
 {
-    class VCamPipe;
+    class ThreadPool;
 }
 
 class CVirtualCameraStream;
@@ -87,7 +96,16 @@ class CVirtualCameraStream;
 class CVirtualCamera: public CSource
 {
 public:
-    static CUnknown* WINAPI CreateInstance(LPUNKNOWN lpunk, HRESULT* phr);
+    /**
+    @brief Create the camera of a pipe channel, one class per channel
+    */
+    template<u32 Channel>
+    static CUnknown* WINAPI CreateInstance(LPUNKNOWN lpunk, HRESULT* phr)
+    {
+        return CreateInstance(lpunk, phr, Channel);
+    }
+
+    static CUnknown* CreateInstance(LPUNKNOWN lpunk, HRESULT* phr, u32 channel);
 
     STDMETHODIMP QueryInterface(REFIID riid, void** ppv);
 
@@ -101,8 +119,15 @@ public:
         return m_State;
     }
 
+    inline u32 GetChannel() const
+    {
+        return channel_;
+    }
+
 private:
-    CVirtualCamera(LPUNKNOWN unknown, HRESULT* result, const GUID guid);
+    CVirtualCamera(LPUNKNOWN unknown, HRESULT* result, const GUID guid, u32 channel);
+
+    u32 channel_ = 0; //!< Pipe channel of this camera
 };
 
 //--- CVirtualCameraStream
@@ -111,6 +136,7 @@ class CVirtualCameraStream
     : public CSourceStream
     , public IAMStreamConfig
     , public IKsPropertySet
+    , public IAMDroppedFrames
 {
 public:
     static constexpr u32 MIN_WIDTH = 320;
@@ -118,17 +144,33 @@ public:
     static constexpr u32 MAX_WIDTH = 4096;
     static constexpr u32 MAX_HEIGHT = 3072;
     static constexpr u32 MAX_FRAMETIME = 1000000;
-    static constexpr u32 MIN_FRAMETIME = 166666;
+    static constexpr u32 MIN_FRAMETIME = 83333;
     static constexpr u32 SLEEP_DURATION = 5;
-    static constexpr u32 MAX_FORMATS = 6;
+    static constexpr u32 RING_DURATION = 666666; //!< Frames arriving within this time fit in the ring
+    static constexpr u32 MIN_RING_FRAMES = 4;
+    static constexpr u32 MAX_RING_FRAMES = 8;
+    static constexpr u32 SAMPLE_DURATION = 333333; //!< Samples delivered within this time may be held downstream at once
+    static constexpr u32 MAX_DROPPED_INFO = 32; //!< Number of the latest dropped frame numbers kept for GetDroppedInfo
+    static constexpr u32 MAX_SAMPLE_BUFFERS = 4; //!< Number of sample buffers whose contents are tracked
 
     struct Format
     {
         u32 width_;
         u32 height_;
-        s64 timePerFrame_;
+        s64 timePerFrame_;    //!< Advertised frame time
+        s64 minTimePerFrame_; //!< Shortest frame time of the resolution, any up to MAX_FRAMETIME is accepted
     };
 
+    /**
+    @return Frames of the ring buffer for a frame time
+    */
+    static u32 getRingFrames(s64 timePerFrame);
+
+    /**
+    @return Advertised formats, built once and shared by every stream
+    */
+    static const std::vector<Format>& getFormats();
+
     CVirtualCameraStream(HRESULT* result, CVirtualCamera* parent, LPCWSTR pinName);
     ~CVirtualCameraStream();
 
@@ -153,6 +195,12 @@ public:
     HRESULT STDMETHODCALLTYPE Get(REFGUID guidPropSet, DWORD dwPropID, void* pInstanceData, DWORD cbInstanceData, void* pPropData, DWORD cbPropData, DWORD* pcbReturned);
     HRESULT STDMETHODCALLTYPE QuerySupported(REFGUID guidPropSet, DWORD dwPropID, DWORD* pTypeSupport);
 
+    // IAMDroppedFrames interfaces
+    HRESULT STDMETHODCALLTYPE GetNumDropped(long* plDropped);
+    HRESULT STDMETHODCALLTYPE GetNumNotDropped(long* plNotDropped);
+    HRESULT STDMETHODCALLTYPE GetDroppedInfo(long lSize, long* plArray, long* plNumCopied);
+    HRESULT STDMETHODCALLTYPE GetAverageFrameSize(long* plAverageSize);
+
     // CSourceStream interfaces
     /**
     @brief Retrieve one media sample
@@ -167,12 +215,64 @@ public:
     HRESULT OnThreadDestroy(void);
 
 private:
+    /**
+    @brief Count frames missing between the previous frame and this one, and stamp the media time with the frame number
+    */
+    void countFrame(IMediaSample* pms, u64 frameNumber);
+
+    /**
+    @brief Check a media type against the advertised formats
+    */
+    HRESULT checkAdvertised(const CMediaType* pMediaType);
+
+    /**
+    @brief Open the pipe for the media type as streaming starts, enumerating formats maps no shared memory
+    */
+    void openPipe();
+
+    /**
+    @brief Write a borrowed frame into a sample buffer, skip rows the buffer already holds
+    */
+    void fillSample(u8* dst, u32 dstSize, const BITMAPINFOHEADER& bmi, const vcam::VCamPipe::ReadView& view, vcam::VCamPipe::Status status);
+
+    /**
+    @brief Frame held by a sample buffer of the allocator
+    */
+    struct SampleBuffer
+    {
+        const u8* buffer_ = nullptr; //!< Address of the sample buffer, nullptr if unused
+        u32 generation_ = 0;         //!< generation_ of the stream when filled
+        u32 sequence_ = 0;           //!< Latest pipe sequence with the same pixels
+        u64 content_ = 0;            //!< content_ of the stream when filled
+    };
+
     CVirtualCamera* parent_ = nullptr;
 
     vcam::VCamPipe* pipe_ = nullptr;
     REFERENCE_TIME lastSyncTime_ = 0;
     REFERENCE_TIME syncTimeout = 0;
     REFERENCE_TIME prevEndTimestamp_ = 0;
-    std::array<Format, MAX_FORMATS> formats_;
+    CCritSec droppedLock_;                                       //!< Guards the counters below against IAMDroppedFrames callers
+    bool hasFrameNumber_ = false;                                //!< Whether nextFrameNumber_ is known
+    u64 nextFrameNumber_ = 0;                                    //!< Frame number expected from the producer
+    u32 lastOverflows_ = 0;                                      //!< VCamPipe::getOverflowedFrames as of the last delivered frame
+    long numDropped_ = 0;                                        //!< Frames of the producer's sequence lost to ring overflow
+    long numNotDropped_ = 0;                                     //!< Frames delivered once
+    std::array<long, MAX_DROPPED_INFO> droppedInfo_ = {};        //!< Ring of the latest dropped frame numbers
+    u32 generation_ = 0;                                         //!< Counts media type and converter changes, which invalidate sample buffers
+    u64 content_ = 0;                                            //!< Counts distinct frames read, repeats keep it
+    u32 nextSampleBuffer_ = 0;                                   //!< Entry of sampleBuffers_ replaced next
+    std::array<SampleBuffer, MAX_SAMPLE_BUFFERS> sampleBuffers_ = {}; //!< Frames held by the allocator's buffers
+    vcam::SystemClock clock_;                                    //!< Clock of pacer_, the same as frame timestamps
+    vcam::FramePacer pacer_{clock_};                             //!< Due times of samples at the negotiated frame rate
+    vcam::JitterBuffer jitter_;                                  //!< Depth of queued frames against an irregular producer
+    u32 ringFrames_ = 0;                                         //!< Slots of the ring jitter_ was capped to, 0 before the first read
+    bool hasFormat_ = false;                                     //!< Set by SetFormat, then m_mt is the only media type offered and accepted
+    vcam::PixelFormat outputFormat_ = vcam::PixelFormat::BGR24; //!< Pixel format of the negotiated media type
+    vcam::Converter converter_ = {};                             //!< Kernels from the producer format to outputFormat_
+    vcam::Scaler scaler_;                                        //!< Resampler for frames of other sizes than the media type
+    std::vector<u8> scaled_;                                     //!< BGRA32 frame resampled by scaler_
+    vcam::ThreadPool* pool_ = nullptr;                           //!< Workers of row bands, alive while streaming
+    const std::vector<Format>& formats_;
 };
 #endif // INC_VCAM_FILTER_H_
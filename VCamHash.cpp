@@ -0,0 +1,162 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamHash.h"
+#include "VCamConvertKernels.h"
+#include <algorithm>
+#include <cstring>
+
+namespace vcam
+{
+namespace
+{
+    const u64 Prime1 = 0x9E3779B185EBCA87ULL;
+    const u64 Prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const u64 Prime3 = 0x165667B19E3779F9ULL;
+    const u64 Prime4 = 0x85EBCA77C2B2AE63ULL;
+    const u64 Prime5 = 0x27D4EB2F165667C5ULL;
+    const u32 Prime32 = 0x9E3779B1U;
+
+    const u64 ChunkSize = 16 * 1024; //!< Copied then hashed while in L1, a multiple of the stripe size
+    const u64 StripeSize = 64;
+
+    const HashStripesFunc HashKernelTable[static_cast<u32>(Isa::Num)] = {
+        kernel::hashStripes,
+#if VCAM_X86
+        kernel::ssse3::hashStripes,
+        kernel::avx2::hashStripes,
+#else
+        nullptr,
+        nullptr,
+#endif
+    };
+
+    u64 rotl(u64 x, u32 r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    /**
+     * @brief Stop a lane from keeping only the low bits of earlier products
+     */
+    void scramble(u64* acc)
+    {
+        for(u32 i = 0; i < 8; ++i) {
+            u64 x = acc[i];
+            x ^= x >> 47;
+            x ^= HashKeys[7 - i];
+            acc[i] = x * Prime32;
+        }
+    }
+} // namespace
+
+u64 copyHash(u8* dst, const u8* src, u64 size, Isa isa)
+{
+    s32 level = (std::min)(static_cast<s32>(isa), static_cast<s32>(Isa::Num) - 1);
+    while(0 < level && nullptr == HashKernelTable[level]) {
+        --level;
+    }
+    HashStripesFunc hashStripes = HashKernelTable[level];
+
+    u64 acc[8] = {Prime32, Prime1, Prime2, Prime3, Prime4, Prime32 ^ Prime5, Prime5, Prime1 ^ Prime4};
+    u64 whole = size & ~(StripeSize - 1);
+    u64 offset = 0;
+    while(offset < whole) {
+        u64 bytes = (std::min)(ChunkSize, whole - offset);
+        if(nullptr != dst) {
+            memcpy(dst + offset, src + offset, bytes);
+        }
+        hashStripes(acc, src + offset, bytes / StripeSize);
+        scramble(acc);
+        offset += bytes;
+    }
+    if(offset < size) {
+        // The last partial stripe is padded with zeros, the length below tells it from real zeros
+        u8 last[StripeSize] = {};
+        memcpy(last, src + offset, size - offset);
+        if(nullptr != dst) {
+            memcpy(dst + offset, src + offset, size - offset);
+        }
+        hashStripes(acc, last, 1);
+    }
+
+    u64 h = size * Prime5;
+    for(u32 i = 0; i < 8; ++i) {
+        h ^= rotl(acc[i] * Prime2, 31) * Prime1;
+        h = rotl(h, 27) * Prime1 + Prime4;
+    }
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return 0 == h ? 1 : h;
+}
+
+namespace kernel
+{
+    void hashStripes(u64* acc, const u8* data, u64 numStripes)
+    {
+        for(u64 s = 0; s < numStripes; ++s) {
+            const u8* stripe = data + s * 64;
+            for(u32 i = 0; i < 8; ++i) {
+                u64 value;
+                memcpy(&value, stripe + i * 8, sizeof(value));
+                u64 key = value ^ HashKeys[i];
+                acc[i ^ 1] += value;
+                acc[i] += (key & 0xFFFFFFFFULL) * (key >> 32);
+            }
+        }
+    }
+} // namespace kernel
+} // namespace vcam
@@ -0,0 +1,95 @@
+﻿#pragma once
+#ifndef INC_VCAM_HASH_H_
+#    define INC_VCAM_HASH_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamConvert.h"
+
+namespace vcam
+{
+/**
+ * @brief Keys mixed into each 64 bit lane of a stripe
+ */
+constexpr u64 HashKeys[8] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+    0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL,
+};
+
+/**
+ * @brief Fold 64 byte stripes into eight 64 bit accumulators
+ *
+ * Each lane adds its input to the other lane of its pair, i xor 1. Lanes combine in the same fixed pairs
+ * on every instruction set, so all of them give the same accumulators.
+ * @param acc [in,out] ... Eight accumulators
+ * @param data [in] ... Stripes
+ * @param numStripes [in] ... Number of 64 byte stripes
+ */
+using HashStripesFunc = void (*)(u64* acc, const u8* data, u64 numStripes);
+
+/**
+ * @brief Copy bytes and hash them in the same pass
+ *
+ * The loop of XXH3 for long inputs, each chunk is hashed right after its copy while it is still in cache.
+ * @param dst [out] ... Destination, nullptr to only hash
+ * @param src [in] ... Source
+ * @param size [in] ... Size in bytes
+ * @param isa [in] ... Highest instruction set to use, usually getCpuIsa()
+ * @return 64 bit hash of src, never 0
+ */
+u64 copyHash(u8* dst, const u8* src, u64 size, Isa isa);
+} // namespace vcam
+#endif // INC_VCAM_HASH_H_
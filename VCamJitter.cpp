@@ -0,0 +1,140 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamJitter.h"
+#include <algorithm>
+
+namespace vcam
+{
+JitterBuffer::JitterBuffer()
+    : dropTarget_(DefaultDropTarget)
+    , readInterval_(0)
+    , maxDepth_(0)
+{
+    reset();
+}
+
+void JitterBuffer::reset()
+{
+    numFrames_ = 0;
+    next_ = 0;
+    period_ = 0;
+    delay_ = 0;
+    targetDepth_ = 0;
+}
+
+void JitterBuffer::setDropTarget(double dropTarget)
+{
+    dropTarget_ = (std::min)((std::max)(dropTarget, 0.0), 1.0);
+}
+
+void JitterBuffer::setReadInterval(u64 interval)
+{
+    readInterval_ = interval;
+}
+
+void JitterBuffer::setMaxDepth(u32 maxDepth)
+{
+    maxDepth_ = maxDepth;
+    targetDepth_ = (std::min)(targetDepth_, maxDepth_);
+}
+
+void JitterBuffer::addFrame(u32 sequence, u64 timestamp)
+{
+    if(0 < numFrames_) {
+        u32 last = (next_ + WindowSize - 1) % WindowSize;
+        if(static_cast<s32>(sequence - sequences_[last]) <= 0) {
+            // Repeats add nothing, and a producer counting from zero again starts over
+            if(sequence != sequences_[last]) {
+                reset();
+            } else {
+                return;
+            }
+        } else if(timestamp < timestamps_[last]) {
+            reset();
+        }
+    }
+    sequences_[next_] = sequence;
+    timestamps_[next_] = timestamp;
+    next_ = (next_ + 1) % WindowSize;
+    numFrames_ = (std::min)(numFrames_ + 1, WindowSize);
+    update();
+}
+
+void JitterBuffer::update()
+{
+    if(numFrames_ < MinFrames || 0 == readInterval_) {
+        return;
+    }
+    u32 first = (next_ + WindowSize - numFrames_) % WindowSize;
+    u32 last = (next_ + WindowSize - 1) % WindowSize;
+    u64 duration = timestamps_[last] - timestamps_[first];
+    u32 frames = sequences_[last] - sequences_[first];
+    period_ = duration / frames;
+
+    // Lateness of each frame against the schedule of the first, then against the earliest frame
+    s64 offsets[WindowSize];
+    for(u32 i = 0; i < numFrames_; ++i) {
+        u32 index = (first + i) % WindowSize;
+        u64 scheduled = static_cast<u64>(sequences_[index] - sequences_[first]) * period_;
+        offsets[i] = static_cast<s64>(timestamps_[index] - timestamps_[first]) - static_cast<s64>(scheduled);
+    }
+    s64 earliest = *std::min_element(offsets, offsets + numFrames_);
+    u32 rank = static_cast<u32>((1.0 - dropTarget_) * (numFrames_ - 1) + 0.5);
+    std::nth_element(offsets, offsets + rank, offsets + numFrames_);
+    delay_ = static_cast<u64>(offsets[rank] - earliest);
+
+    u64 depth = (delay_ + readInterval_ - 1) / readInterval_;
+    targetDepth_ = static_cast<u32>((std::min)(depth, static_cast<u64>(maxDepth_)));
+}
+} // namespace vcam
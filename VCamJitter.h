@@ -0,0 +1,146 @@
+﻿#pragma once
+#ifndef INC_VCAM_JITTER_H_
+#    define INC_VCAM_JITTER_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamPlatform.h"
+
+namespace vcam
+{
+/**
+ * @brief Target depth of VCamPipe::ReadPolicy::Buffered from the timing of producer frames
+ *
+ * Frame timestamps are compared with a regular schedule at the producer's average period over a window of frames.
+ * How far frames fall behind the earliest of them is the delay to buffer, the depth covers it for all but the drop target of frames.
+ * A steady producer gets depth 0, the newest frame as with ReadPolicy::Latest.
+ */
+class JitterBuffer
+{
+public:
+    static constexpr u32 WindowSize = 128;          //!< Frames of the estimate
+    static constexpr u32 MinFrames = 8;             //!< Depth stays 0 until this many frames were seen
+    static constexpr double DefaultDropTarget = 0.01;
+
+    JitterBuffer();
+
+    /**
+     * @brief Forget frames seen, as when the producer restarts
+     */
+    void reset();
+
+    /**
+     * @brief Set the fraction of frames which may come too late to be shown, lower rates buffer more
+     */
+    void setDropTarget(double dropTarget);
+
+    /**
+     * @param interval [in] ... Nanoseconds between reads
+     */
+    void setReadInterval(u64 interval);
+
+    /**
+     * @param maxDepth [in] ... Highest depth, the queue the ring has room for
+     */
+    void setMaxDepth(u32 maxDepth);
+
+    /**
+     * @brief Add a frame read, frames skipped in between are accounted by the gap of sequences
+     * @param sequence [in] ... sequence_ of the frame
+     * @param timestamp [in] ... Capture time of the frame in nanoseconds
+     */
+    void addFrame(u32 sequence, u64 timestamp);
+
+    /**
+     * @return Frames to keep queued
+     */
+    u32 getTargetDepth() const
+    {
+        return targetDepth_;
+    }
+
+    /**
+     * @return Average nanoseconds between producer frames over the window, 0 if unknown
+     */
+    u64 getPeriod() const
+    {
+        return period_;
+    }
+
+    /**
+     * @return Delay in nanoseconds which covers all but the drop target of frames
+     */
+    u64 getDelay() const
+    {
+        return delay_;
+    }
+
+private:
+    void update();
+
+    double dropTarget_;
+    u64 readInterval_;
+    u32 maxDepth_;
+    u32 numFrames_;                //!< Frames in the window
+    u32 next_;                     //!< Index of the window to write next
+    u32 sequences_[WindowSize];
+    u64 timestamps_[WindowSize];
+    u64 period_;
+    u64 delay_;
+    u32 targetDepth_;
+};
+} // namespace vcam
+#endif // INC_VCAM_JITTER_H_
@@ -0,0 +1,213 @@
+﻿#pragma once
+#ifndef INC_VCAM_PACER_H_
+#    define INC_VCAM_PACER_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamPlatform.h"
+
+namespace vcam
+{
+/**
+ * @brief Time source of FramePacer
+ *
+ * Replaced by VirtualClock, pacing runs without real time and sleeping.
+ */
+class Clock
+{
+public:
+    virtual ~Clock()
+    {
+    }
+
+    /**
+     * @return Nanoseconds of a monotonic clock
+     */
+    virtual u64 now() = 0;
+
+    /**
+     * @brief Return when now reaches time
+     */
+    virtual void sleepUntil(u64 time) = 0;
+};
+
+/**
+ * @brief getMonotonicTime, the clock of frame timestamps
+ */
+class SystemClock : public Clock
+{
+public:
+    u64 now() override
+    {
+        return getMonotonicTime();
+    }
+
+    void sleepUntil(u64 time) override
+    {
+        vcam::sleepUntil(time);
+    }
+};
+
+/**
+ * @brief Clock which only moves when told, sleeping jumps to the time
+ */
+class VirtualClock : public Clock
+{
+public:
+    explicit VirtualClock(u64 time = 0)
+        : time_(time)
+    {
+    }
+
+    u64 now() override
+    {
+        return time_;
+    }
+
+    void sleepUntil(u64 time) override
+    {
+        time_ = time_ < time ? time : time_;
+    }
+
+    /**
+     * @brief Pass time, as the work between two waits would
+     */
+    void advance(u64 duration)
+    {
+        time_ += duration;
+    }
+
+private:
+    u64 time_;
+};
+
+/**
+ * @brief Deadlines of a fixed frame rate
+ *
+ * Deadline n is the start time plus n intervals, not the last wake up plus one,
+ * so oversleeping and the work between waits never add up to drift.
+ * A caller late by whole intervals skips the deadlines it missed rather than catching up in a burst.
+ */
+class FramePacer
+{
+public:
+    explicit FramePacer(Clock& clock);
+
+    /**
+     * @brief Start deadlines from now
+     * @param interval [in] ... Nanoseconds between frames
+     */
+    void start(u64 interval);
+
+    /**
+     * @brief Forget deadlines, wait starts them again
+     */
+    void stop();
+
+    bool isStarted() const
+    {
+        return started_;
+    }
+
+    u64 getInterval() const
+    {
+        return interval_;
+    }
+
+    /**
+     * @return Time of the first deadline
+     */
+    u64 getOrigin() const
+    {
+        return origin_;
+    }
+
+    /**
+     * @return Deadline returned by the last wait
+     */
+    u64 getDeadline() const
+    {
+        return deadline_;
+    }
+
+    /**
+     * @return Deadlines skipped for being late since start
+     */
+    u32 getMissed() const
+    {
+        return missed_;
+    }
+
+    /**
+     * @brief Sleep until the next deadline
+     * @return The deadline, the due time of the next frame
+     */
+    u64 wait();
+
+private:
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    Clock* clock_;
+    bool started_ = false;
+    u64 interval_ = 0;
+    u64 origin_ = 0;
+    u64 index_ = 0;    //!< Number of the next deadline
+    u64 deadline_ = 0;
+    u32 missed_ = 0;
+};
+} // namespace vcam
+#endif // INC_VCAM_PACER_H_
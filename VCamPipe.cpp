@@ -52,13 +52,111 @@ For more information, please refer to <http://unlicense.org>
 */
 // clang-format on
 #include "VCamPipe.h"
+#include "VCamHash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <thread>
 #include <utility>
 namespace vcam
 {
 namespace
 {
-    const char* VCamePipeMutexName = "VCamePipeMutex"; // Mutex name
+    void setTile(u64* tiles, u32 index)
+    {
+        tiles[index >> 6] |= 1ULL << (index & 63);
+    }
+
+    bool getTile(const u64* tiles, u32 index)
+    {
+        return 0 != (tiles[index >> 6] & (1ULL << (index & 63)));
+    }
+
     const char* VCamePipeMappingName = "VCamePipeMapping"; // Shared memory name
+    const char* VCamePipeFrameEventName = "VCamePipeFrameEvent"; // Event name of published frames, followed by the cursor index
+    const char* VCamePipeSlotEventName = "VCamePipeSlotEvent"; // Event name of freed slots
+    const char* VCamePipeDirectoryName = "VCamePipeDirectory"; // Shared memory name of the channel directory
+    const char* VCamePipeRingName = "VCamePipeRing"; // Shared memory name of rings, followed by the generation
+
+    // Slots of a new ring hold a counter value this far behind every one in use, so they read as never written
+    constexpr u32 UnwrittenDistance = 0x40000000U;
+
+    // Channel 0 keeps the names of a single camera, other channels append their index
+    void getChannelObjectName(char* name, size_t size, const char* base, u32 channel)
+    {
+        if(0 == channel) {
+            snprintf(name, size, "%s", base);
+        } else {
+            snprintf(name, size, "%s%u", base, channel);
+        }
+    }
+
+    bool openFrameEvent(WordEvent& event, u32 channel, u32 index)
+    {
+        char base[64];
+        char name[80];
+        getChannelObjectName(base, sizeof(base), VCamePipeFrameEventName, channel);
+        snprintf(name, sizeof(name), "%s_%u", base, index);
+        return event.open(name);
+    }
+
+    void getRingName(char* name, size_t size, u32 channel, u32 generation)
+    {
+        char base[64];
+        getChannelObjectName(base, sizeof(base), VCamePipeRingName, channel);
+        snprintf(name, size, "%s_%u", base, generation);
+    }
+
+    // Counters wrap at 2^32, slots of a power of two keep counter modulo slots continuous over the wrap
+    u32 roundUpPowerOfTwo(u32 x)
+    {
+        u32 power = 1;
+        while(power < x) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    u64 roundUp(u64 size, u64 alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    u64 roundUpPages(u64 size)
+    {
+        return roundUp(size, getPageSize());
+    }
+
+    bool openSegment(SharedMemory& memory, WordEvent& slotEvent, u32 channel, u64 createSize, bool readOnly)
+    {
+        char name[64];
+        getChannelObjectName(name, sizeof(name), VCamePipeMappingName, channel);
+        bool opened = 0 < createSize ? memory.create(name, createSize) : memory.open(name, readOnly);
+        if(!opened || readOnly) {
+            return opened;
+        }
+        getChannelObjectName(name, sizeof(name), VCamePipeSlotEventName, channel);
+        return slotEvent.open(name);
+    }
+
+    // Spin until state is not locked and take it, a holder of longer than timeout has died
+    u32 lockState(std::atomic<u32>& state, u32 locked, u32 timeout)
+    {
+        u64 deadline = getMonotonicTime() + timeout * 1000000ULL;
+        for(;;) {
+            u32 previous = state.load(std::memory_order_relaxed);
+            if(locked != previous && state.compare_exchange_weak(previous, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return previous;
+            }
+            if(deadline <= getMonotonicTime()) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return locked;
+            }
+            std::this_thread::yield();
+        }
+    }
 }
 
 VCamPipe::VCamPipe()
@@ -70,79 +168,110 @@ VCamPipe::~VCamPipe()
     close();
 }
 
-bool VCamPipe::openRead(u32 width, u32 height, u32 bpp, u32 maxFrames, u32 sizePerFrame)
+bool VCamPipe::openRead(u32 width, u32 height, u32 bpp, u32 maxFrames, u32 sizePerFrame, u32 channel)
 {
-    //Calc buffer size
-    u32 minimumSize = getPageSize();
-    if(minimumSize <= 0) {
+    if(MaxChannels <= channel || getPageSize() <= 0) {
         return false;
     }
-    u32 desiredSize = maxFrames * sizePerFrame + sizeof(Entry) * maxFrames + sizeof(Header);
-    if(desiredSize < minimumSize) {
-        desiredSize = minimumSize;
-    }
-    u32 totalSize = 0;
-    while(totalSize < desiredSize) {
-        totalSize += minimumSize;
-    }
 
-    // Create named mutex
-    mutex_ = CreateMutexA(NULL, FALSE, (VCamePipeMutexName));
-    if(nullptr == mutex_) {
+    // Create named mapped file, or open the live one
+    if(!openSegment(memory_, slotEvent_, channel, getControlSize(), false)) {
+        close();
         return false;
     }
+    channel_ = channel;
+    mapped_ = memory_.data();
+    map();
+    policy_ = ReadPolicy::Queue;
+    targetDepth_ = 0;
 
-    // Create named mapped file
-    file_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, totalSize, (VCamePipeMappingName));
-    if(nullptr == file_) {
-        close();
-        return false;
+    // Other readers and the writer keep using a live pipe, only a new one or one of no readers is set up
+    bool isReady = SegmentReady == lockSegment();
+    bool isLive = false;
+    for(u32 i = 0; isReady && i < MaxReaders; ++i) {
+        isLive = isLive || CursorFree != cursors_[i].state_.load(std::memory_order_acquire);
+    }
+    if(!isLive) {
+        header_->height_ = height;
+        header_->width_ = width;
+        header_->bpp_ = bpp;
+    }
+    // A live ring keeps its slots and only grows, otherwise the ring is sized for this format
+    maxFrames = roundUpPowerOfTwo(maxFrames);
+    bool fits = isLive ? sizePerFrame <= header_->sizePerFrame_ : header_->maxFrames_ == maxFrames && header_->sizePerFrame_ == sizePerFrame;
+    if(!isReady) {
+        // Generations carry on, so a ring of a dead pipe is never taken for a new one
+        header_->overflow_ = OverflowPolicy::DropOldest;
+        header_->blockTimeout_ = DefaultBlockTimeout;
+        header_->nextOwner_ = 0;
+        header_->writeWaiters_.store(0, std::memory_order_relaxed);
+        header_->tail_.store(0, std::memory_order_relaxed);
+        header_->frameNumber_ = 0;
+        for(u32 i = 0; i < MaxReaders; ++i) {
+            new(&cursors_[i]) Cursor();
+            cursors_[i].state_.store(CursorFree, std::memory_order_relaxed);
+            cursors_[i].waiters_.store(0, std::memory_order_relaxed);
+        }
+        new(stats_) PipeStats();
+    } else if(!isLive && !fits) {
+        header_->overflow_ = OverflowPolicy::DropOldest;
+        header_->blockTimeout_ = DefaultBlockTimeout;
+        new(stats_) PipeStats();
+    }
+    bool claimed = claimCursor();
+    bool attached = claimed && isReady && fits && attachRing();
+    if(claimed && !attached) {
+        u32 ringFrames = isLive ? header_->maxFrames_ : maxFrames;
+        u32 ringSize = isLive ? (std::max)(header_->sizePerFrame_, sizePerFrame) : sizePerFrame;
+        attached = growRing(ringFrames, ringSize);
     }
-    mapped_ = reinterpret_cast<u8*>(MapViewOfFile(file_, FILE_MAP_ALL_ACCESS, 0, 0, totalSize));
-    if(nullptr == mapped_) {
+    header_->state_.store(SegmentReady, std::memory_order_release);
+    if(!attached) {
         close();
         return false;
     }
-
-    // Retrieve mapped pointers
-    header_ = reinterpret_cast<Header*>(mapped_);
-    entries_ = reinterpret_cast<Entry*>(mapped_ + sizeof(Header));
-    data_ = mapped_ + sizeof(Header) + sizeof(Entry) * maxFrames;
-
-    // Set up stream information
-    memset(header_, 0, sizeof(Header));
-    header_->height_ = height;
-    header_->width_ = width;
-    header_->bpp_ = bpp;
-    header_->maxFrames_ = maxFrames;
-    header_->sizePerFrame_ = sizePerFrame;
-    data_ = mapped_ + sizeof(Header) + sizeof(Entry) * header_->maxFrames_;
-    for(size_t i = 0; i < header_->maxFrames_; ++i) {
-        entries_[i] = {};
-        entries_[i].offset_ = i*header_->sizePerFrame_;
-    }
+    hasLastFrame_ = false;
     return true;
 }
 
-bool VCamPipe::openWrite()
+bool VCamPipe::openWrite(u32 channel)
 {
-    mutex_ = OpenMutexA(MUTEX_ALL_ACCESS, FALSE, (VCamePipeMutexName));
-    if(nullptr == mutex_) {
+    if(MaxChannels <= channel || !openSegment(memory_, slotEvent_, channel, 0, false)) {
+        close();
         return false;
     }
-    file_ = OpenFileMappingA(FILE_MAP_WRITE|FILE_MAP_READ, FALSE, (VCamePipeMappingName));
-    if(nullptr == file_) {
+    channel_ = channel;
+    // Readers come and go, the writer signals each of their cursors
+    for(u32 i = 0; i < MaxReaders; ++i) {
+        if(!openFrameEvent(frameEvents_[i], channel, i)) {
+            close();
+            return false;
+        }
+    }
+    mapped_ = memory_.data();
+    map();
+    if(!recoverRing()) {
         close();
         return false;
     }
-    mapped_ = reinterpret_cast<u8*>(MapViewOfFile(file_, FILE_MAP_WRITE|FILE_MAP_READ, 0, 0, 0));
-    if(nullptr == mapped_) {
+    // Readers which come and go leave the names to this writer until it closes
+    u32 state = lockSegment();
+    ++header_->writers_;
+    header_->state_.store(state, std::memory_order_release);
+    writer_ = true;
+    return true;
+}
+
+bool VCamPipe::openMonitor(u32 channel)
+{
+    if(MaxChannels <= channel || !openSegment(memory_, slotEvent_, channel, 0, true)) {
         close();
         return false;
     }
-    header_ = reinterpret_cast<Header*>(mapped_);
-    entries_ = reinterpret_cast<Entry*>(mapped_ + sizeof(Header));
-    data_ = mapped_ + sizeof(Header) + sizeof(Entry) * header_->maxFrames_;
+    channel_ = channel;
+    mapped_ = memory_.data();
+    readOnly_ = true;
+    map();
     return true;
 }
 
@@ -153,22 +282,24 @@ bool VCamPipe::connected() const
 
 void VCamPipe::close()
 {
+    detach();
     data_ = nullptr;
     entries_ = nullptr;
+    ring_ = nullptr;
+    stats_ = nullptr;
+    cursors_ = nullptr;
     header_ = nullptr;
+    channel_ = 0;
+    readOnly_ = false;
+    hasLastFrame_ = false;
 
-    if(nullptr != mapped_) {
-        UnmapViewOfFile(mapped_);
-        mapped_ = nullptr;
-    }
-    if(nullptr != file_) {
-        CloseHandle(file_);
-        file_ = nullptr;
-    }
-    if(nullptr != mutex_) {
-        CloseHandle(mutex_);
-        mutex_ = nullptr;
+    mapped_ = nullptr;
+    for(WordEvent& event: frameEvents_) {
+        event.close();
     }
+    slotEvent_.close();
+    ringMemory_.close();
+    memory_.close();
 }
 
 bool VCamPipe::getFormat(u32& width, u32& height, u32& bpp) const
@@ -192,84 +323,1029 @@ bool VCamPipe::checkFormat(u32 width, u32 height, u32 bpp)
 
 void VCamPipe::setFormat(u32 width, u32 height, u32 bpp)
 {
+    if(nullptr == header_ || readOnly_) {
+        return;
+    }
     header_->width_ = width;
     header_->height_ = height;
     header_->bpp_ = bpp;
 }
 
-bool VCamPipe::push(u32 width, u32 height, u32 bpp, u8* data, u32 timeout)
+void VCamPipe::setReadPolicy(ReadPolicy policy)
+{
+    if(nullptr == cursor_) {
+        return;
+    }
+    policy_ = policy;
+    cursor_->policy_ = policy;
+}
+
+VCamPipe::ReadPolicy VCamPipe::getReadPolicy() const
+{
+    return policy_;
+}
+
+void VCamPipe::setOverflowPolicy(OverflowPolicy policy, u32 timeout)
+{
+    if(nullptr == header_ || readOnly_) {
+        return;
+    }
+    header_->overflow_ = policy;
+    header_->blockTimeout_ = timeout;
+}
+
+VCamPipe::OverflowPolicy VCamPipe::getOverflowPolicy() const
+{
+    return nullptr == header_ ? OverflowPolicy::DropOldest : header_->overflow_;
+}
+
+void VCamPipe::setTargetDepth(u32 depth)
+{
+    if(nullptr == cursor_) {
+        return;
+    }
+    u32 maxDepth = 2 < ring_->maxFrames_ ? ring_->maxFrames_ - 2 : 0;
+    targetDepth_ = (std::min)(depth, maxDepth);
+    cursor_->targetDepth_ = targetDepth_;
+}
+
+u32 VCamPipe::getTargetDepth() const
+{
+    return targetDepth_;
+}
+
+u32 VCamPipe::getMaxFrames() const
+{
+    if(nullptr == header_) {
+        return 0;
+    }
+    return nullptr == ring_ ? header_->maxFrames_ : ring_->maxFrames_;
+}
+
+u32 VCamPipe::getSkippedFrames() const
 {
     if(nullptr == header_) {
+        return 0;
+    }
+    return nullptr == cursor_ ? stats_->skipped_.load(std::memory_order_relaxed) : cursor_->skipped_.load(std::memory_order_relaxed);
+}
+
+u32 VCamPipe::getOverflowedFrames() const
+{
+    if(nullptr == header_ || nullptr == cursor_) {
+        return 0;
+    }
+    return cursor_->overflows_.load(std::memory_order_relaxed);
+}
+
+u32 VCamPipe::getReaders(ReaderInfo* readers, u32 maxReaders) const
+{
+    if(nullptr == header_) {
+        return 0;
+    }
+    u32 tail = header_->tail_.load(std::memory_order_acquire);
+    u32 count = 0;
+    for(u32 i = 0; i < MaxReaders && count < maxReaders; ++i) {
+        const Cursor& cursor = cursors_[i];
+        u32 state = cursor.state_.load(std::memory_order_acquire);
+        if(CursorActive != state && CursorStale != state) {
+            continue;
+        }
+        ReaderInfo& reader = readers[count++];
+        reader.index_ = i;
+        reader.stale_ = CursorStale == state;
+        reader.policy_ = cursor.policy_;
+        reader.targetDepth_ = cursor.targetDepth_;
+        // A stale reader falls behind without bound, the ring keeps at most maxFrames_ of its frames
+        reader.queued_ = (std::min)(tail - cursor.head_.load(std::memory_order_relaxed), header_->maxFrames_);
+        reader.skipped_ = cursor.skipped_.load(std::memory_order_relaxed);
+        reader.overflowed_ = cursor.overflows_.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+bool VCamPipe::push(u32 width, u32 height, u32 bpp, const u8* data, u32)
+{
+    WriteSlot slot;
+    if(!acquireWriteSlot(slot, width, height, bpp)) {
+        return false;
+    }
+    copyAndCommit(slot, data, slot.pitch_ * height);
+    return true;
+}
+
+bool VCamPipe::push(u32 width, u32 height, PixelFormat format, u32 flags, const u8* data)
+{
+    WriteSlot slot;
+    if(!acquireWriteSlot(slot, width, height, format, flags)) {
         return false;
     }
-    if(WAIT_OBJECT_0 != WaitForSingleObject(mutex_, timeout)) {
+    copyAndCommit(slot, data, slot.pitch_ * height);
+    return true;
+}
+
+bool VCamPipe::pushDelta(u32 width, u32 height, PixelFormat format, u32 flags, const u8* data, const Rect* rects, u32 numRects)
+{
+    u32 columns = getTileColumns(width);
+    u32 rows = getTileRows(height);
+    if(nullptr == header_ || readOnly_ || !recoverRing() || isYuv(format) || MaxTiles < columns * rows) {
+        return push(width, height, format, flags, data);
+    }
+
+    // Only the producer writes slots, so their metadata can be read before acquiring the next one
+    u32 tail = header_->tail_.load(std::memory_order_relaxed);
+    u32 maxFrames = ring_->maxFrames_;
+    u32 generation = ring_->generation_;
+    bool hasPrevious = isComplete(tail - 1, width, height, format, flags);
+    // The slot holds the frame maxFrames before, then the frames after it tell which of its tiles are stale
+    bool carry = isComplete(tail - maxFrames, width, height, format, flags);
+    u64 stale[TileWords] = {};
+    for(u32 i = 1; carry && i < maxFrames; ++i) {
+        const Entry& entry = slot(tail - i);
+        carry = isComplete(tail - i, width, height, format, flags) && 0 != (entry.flags_ & FrameFlag_Delta);
+        for(u32 j = 0; carry && j < TileWords; ++j) {
+            stale[j] |= entry.tiles_[j];
+        }
+    }
+
+    WriteSlot slot;
+    if(!acquireWriteSlot(slot, width, height, format, flags)) {
         return false;
     }
-    if(header_->maxFrames_ <= header_->size_) {
-        header_->head_ = next(header_->head_);
+    if(generation != ring_->generation_) {
+        // The ring grew for this frame, the frames before are gone
+        hasPrevious = false;
+        carry = false;
+    }
+    Entry& entry = this->slot(slot.sequence_);
+    u64* dirty = entry.tiles_;
+    memset(dirty, 0, sizeof(entry.tiles_));
+    u32 bpp = getBytesPerPixel(format);
+    u32 pitch = slot.pitch_;
+    u32 tileBytes = TileSize * bpp;
+    const u8* previous = hasPrevious ? &data_[this->slot(tail - 1).offset_] : nullptr;
+    bool topDown = 0 != (flags & FrameFlag_TopDown);
+
+    if(nullptr != rects) {
+        for(u32 i = 0; i < numRects; ++i) {
+            const Rect& rect = rects[i];
+            if(width <= rect.x_ || height <= rect.y_ || 0 == rect.width_ || 0 == rect.height_) {
+                continue;
+            }
+            // Tiles are in memory order, the bottom row comes first in a bottom-up frame
+            u32 right = (std::min)(width, rect.x_ + rect.width_);
+            u32 bottom = (std::min)(height, rect.y_ + rect.height_);
+            u32 top = topDown ? rect.y_ : height - bottom;
+            bottom = topDown ? bottom : height - rect.y_;
+            for(u32 y = top / TileSize; y <= (bottom - 1) / TileSize; ++y) {
+                for(u32 x = rect.x_ / TileSize; x <= (right - 1) / TileSize; ++x) {
+                    setTile(dirty, x + y * columns);
+                }
+            }
+        }
+    } else if(hasPrevious) {
+        for(u32 y = 0; y < height; ++y) {
+            const u8* src = data + static_cast<size_t>(pitch) * y;
+            const u8* prev = previous + static_cast<size_t>(pitch) * y;
+            u32 rowTiles = (y / TileSize) * columns;
+            for(u32 x = 0; x < columns; ++x) {
+                if(getTile(dirty, rowTiles + x)) {
+                    continue;
+                }
+                u32 offset = x * tileBytes;
+                if(0 != memcmp(src + offset, prev + offset, (std::min)(tileBytes, pitch - offset))) {
+                    setTile(dirty, rowTiles + x);
+                }
+            }
+        }
+    } else {
+        memset(dirty, 0xFF, sizeof(entry.tiles_));
+    }
+
+    if(!carry || nullptr == previous) {
+        memcpy(slot.data_, data, static_cast<size_t>(pitch) * height);
+        addCounter(stats_->tilesCopied_, columns * rows);
     } else {
-        header_->size_ += 1;
+        // Copy runs of tiles, changed ones from the caller and stale ones from the previous frame
+        u32 copied = 0;
+        for(u32 y = 0; y < rows; ++y) {
+            u32 rowBegin = y * TileSize;
+            u32 rowEnd = (std::min)(height, rowBegin + TileSize);
+            for(u32 x = 0; x < columns;) {
+                u32 index = x + y * columns;
+                bool isDirty = getTile(dirty, index);
+                if(!isDirty && !getTile(stale, index)) {
+                    ++x;
+                    continue;
+                }
+                const u8* src = isDirty ? data : previous;
+                u32 end = x + 1;
+                while(end < columns && isDirty == getTile(dirty, end + y * columns) && (isDirty || getTile(stale, end + y * columns))) {
+                    ++end;
+                }
+                u32 offset = x * tileBytes;
+                u32 size = (std::min)(end * tileBytes, pitch) - offset;
+                for(u32 row = rowBegin; row < rowEnd; ++row) {
+                    memcpy(slot.data_ + static_cast<size_t>(pitch) * row + offset, src + static_cast<size_t>(pitch) * row + offset, size);
+                }
+                copied += end - x;
+                x = end;
+            }
+        }
+        addCounter(stats_->tilesCopied_, copied);
+        addCounter(stats_->tilesSkipped_, columns * rows - copied);
+    }
+    if(hasPrevious) {
+        entry.flags_ |= FrameFlag_Delta;
+        bool changed = false;
+        for(u32 i = 0; !changed && i < TileWords; ++i) {
+            changed = 0 != dirty[i];
+        }
+        if(!changed) {
+            setDuplicate(entry, this->slot(tail - 1));
+        }
+    }
+    commit(slot);
+    return true;
+}
+
+void VCamPipe::copyAndCommit(WriteSlot& slot, const u8* data, u32 size)
+{
+    Entry& entry = this->slot(slot.sequence_);
+    entry.hash_ = copyHash(slot.data_, data, size, getCpuIsa());
+    u32 previous = slot.sequence_ - 1;
+    if(isComplete(previous, entry.width_, entry.height_, entry.format_, entry.flags_) && this->slot(previous).hash_ == entry.hash_) {
+        setDuplicate(entry, this->slot(previous));
+    }
+    commit(slot);
+}
+
+void VCamPipe::setDuplicate(Entry& entry, const Entry& previous)
+{
+    entry.flags_ |= FrameFlag_Duplicate;
+    entry.sameAs_ = previous.sameAs_;
+    entry.hash_ = previous.hash_;
+    addCounter(stats_->duplicates_);
+}
+
+bool VCamPipe::acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, u32 bpp)
+{
+    PixelFormat format = PixelFormat::Unknown;
+    switch(bpp) {
+    case 3:
+        format = PixelFormat::BGR24;
+        break;
+    case 4:
+        format = PixelFormat::BGRA32;
+        break;
+    }
+    return acquireWriteSlot(slot, width, height, format, bpp, FrameFlag_None);
+}
+
+bool VCamPipe::acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, PixelFormat format, u32 flags)
+{
+    return acquireWriteSlot(slot, width, height, format, getBytesPerPixel(format), flags);
+}
+
+bool VCamPipe::acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, PixelFormat format, u32 bpp, u32 flags)
+{
+    slot = {};
+    if(nullptr == header_ || readOnly_ || 0 == bpp) {
+        return false;
+    }
+    u32 size = bpp * width * height;
+    // A frame larger than the negotiated format grows the ring for every side
+    if(!reserve(0, size)) {
+        return false;
+    }
+    // Only the producer writes tail_
+    u32 tail = header_->tail_.load(std::memory_order_relaxed);
+    Cursor* slowest = nullptr;
+    u32 head = getSlowestHead(tail, slowest);
+    OverflowPolicy overflow = header_->overflow_;
+    Entry& entry = this->slot(tail);
+    if(OverflowPolicy::Block == overflow && (ring_->maxFrames_ <= (tail - head) || 0 != entry.state_.load(std::memory_order_relaxed))) {
+        u64 blockStartTime = getMonotonicTime();
+        bool isFree = waitSlot(tail);
+        addCounter(stats_->blocked_);
+        stats_->blockTime_.record(getMonotonicTime() - blockStartTime);
+        if(!isFree) {
+            addCounter(stats_->rejected_);
+            return false;
+        }
+        head = getSlowestHead(tail, slowest);
+    }
+    bool isFull = ring_->maxFrames_ <= (tail - head);
+    if(isFull && OverflowPolicy::DropOldest != overflow) {
+        // Keep the queued frames, this one is lost
+        addCounter(stats_->rejected_);
+        return false;
+    }
+
+    // Claimed before any frame is dropped, a slot still pinned costs this frame only
+    u32 state = 0;
+    if(!entry.state_.compare_exchange_strong(state, SlotWriting, std::memory_order_acquire, std::memory_order_relaxed)) {
+        // The consumer is still copying the frame in this slot, or a slot is already acquired
+        addCounter(stats_->writeBusy_);
+        return false;
+    }
+    if(isFull) {
+        // Drop the oldest frame of every reader which has not taken it, failure means the reader has just taken it
+        bool dropped = false;
+        u32 oldest = tail - ring_->maxFrames_ + 1;
+        for(u32 i = 0; i < MaxReaders; ++i) {
+            Cursor& cursor = cursors_[i];
+            u32 cursorHead = cursor.head_.load(std::memory_order_acquire);
+            if(CursorActive == cursor.state_.load(std::memory_order_relaxed) && 0 < static_cast<s32>(oldest - cursorHead)) {
+                if(cursor.head_.compare_exchange_strong(cursorHead, oldest, std::memory_order_acq_rel)) {
+                    addCounter(cursor.overflows_, oldest - cursorHead);
+                    dropped = true;
+                }
+            }
+        }
+        if(dropped) {
+            addCounter(stats_->overflows_);
+        }
     }
-    Entry& entry = entries_[header_->tail_];
+    // Not published until tail_ passes it, so the consumer never matches this sequence early
+    entry.sequence_ = tail;
+    entry.complete_ = 0;
+    entry.sameAs_ = tail;
+    entry.hash_ = 0;
     entry.width_ = width;
     entry.height_ = height;
     entry.bpp_ = bpp;
-    u32 size = bpp * width * height;
-    memcpy(&data_[entry.offset_], data, size);
-    header_->tail_ = next(header_->tail_);
-    ReleaseMutex(mutex_);
+    entry.format_ = format;
+    entry.flags_ = flags & ~FrameFlag_Delta;
+
+    slot.data_ = &data_[entry.offset_];
+    slot.pitch_ = bpp * width;
+    slot.capacity_ = ring_->sizePerFrame_;
+    slot.sequence_ = tail;
+    slot.frameNumber_ = header_->frameNumber_;
+    slot.timestamp_ = getMonotonicTime();
+    writeStartTime_ = slot.timestamp_;
     return true;
 }
 
+void VCamPipe::commit(WriteSlot& slot)
+{
+    if(nullptr == slot.data_) {
+        return;
+    }
+    Entry& entry = this->slot(slot.sequence_);
+    if(ring_->generation_ != header_->generation_.load(std::memory_order_acquire)) {
+        // Readers have moved to a new ring which does not hold this frame
+        abort(slot);
+        addCounter(stats_->rejected_);
+        return;
+    }
+    entry.frameNumber_ = slot.frameNumber_;
+    entry.timestamp_ = slot.timestamp_;
+    entry.complete_ = 1;
+    header_->frameNumber_ = slot.frameNumber_ + 1;
+    entry.state_.store(0, std::memory_order_release);
+    header_->tail_.store(slot.sequence_ + 1, std::memory_order_release);
+    // Pairs with the increment of waiters_ in waitFrame, either the reader sees the new tail or this sees the reader
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for(u32 i = 0; i < MaxReaders; ++i) {
+        if(0 < cursors_[i].waiters_.load(std::memory_order_relaxed)) {
+            frameEvents_[i].notify(header_->tail_);
+        }
+    }
+    addCounter(stats_->pushed_);
+    stats_->writeTime_.record(getMonotonicTime() - writeStartTime_);
+    slot = {};
+}
+
+void VCamPipe::abort(WriteSlot& slot)
+{
+    if(nullptr == slot.data_) {
+        return;
+    }
+    this->slot(slot.sequence_).state_.store(0, std::memory_order_release);
+    slot = {};
+}
+
 VCamPipe::Status VCamPipe::pop(u8* dst, u32 dstSize, u32& width, u32& height, u32& bpp, s64 lastSyncTime, s64 currentTime, s64 syncTimeout, u32 timeout)
 {
-    if(nullptr == header_) {
-        return Status::Fail;
+    waitFrame(timeout);
+    ReadView view;
+    Status status = peekRead(view, lastSyncTime, currentTime, syncTimeout);
+    if(Status::Success != status && Status::RepeatLastFrame != status) {
+        return status;
+    }
+    width = view.width_;
+    height = view.height_;
+    bpp = view.bpp_;
+    u32 size = (std::min)(view.pitch_ * view.height_, dstSize);
+    memcpy(dst, view.data_, size);
+    release(view);
+    return status;
+}
+
+bool VCamPipe::waitFrame(u32 milliseconds)
+{
+    if(nullptr == header_ || readOnly_ || !touchCursor()) {
+        return false;
+    }
+    u64 startTime = getMonotonicTime();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    Cursor& cursor = *cursor_;
+    for(;;) {
+        u32 tail = header_->tail_.load(std::memory_order_acquire);
+        if(tail != cursor.head_.load(std::memory_order_acquire)) {
+            stats_->waitTime_.recordShared(getMonotonicTime() - startTime);
+            return true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(deadline <= now) {
+            stats_->waitTime_.recordShared(getMonotonicTime() - startTime);
+            return false;
+        }
+        u32 remaining = static_cast<u32>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        cursor.waiters_.fetch_add(1, std::memory_order_seq_cst);
+        if(tail == header_->tail_.load(std::memory_order_seq_cst)) {
+            frameEvents_[cursorIndex_].wait(header_->tail_, tail, remaining);
+        }
+        cursor.waiters_.fetch_sub(1, std::memory_order_relaxed);
+        // A long wait counts as reading, the writer keeps the frames
+        cursor.heartbeat_.store(getHeartbeat(), std::memory_order_relaxed);
     }
-    if(WAIT_OBJECT_0 != WaitForSingleObject(mutex_, timeout)) {
+}
+
+VCamPipe::Status VCamPipe::peekRead(ReadView& view, s64 lastSyncTime, s64 currentTime, s64 syncTimeout, u64 deadline)
+{
+    view = {};
+    if(nullptr == header_ || readOnly_ || !touchCursor()) {
         return Status::Fail;
     }
-    Lock lock(mutex_);
+    Cursor& cursor = *cursor_;
 
-    Entry& entry = entries_[header_->head_];
-    if(header_->size_ <= 0) {
-        //Have no last frames
-        if(entry.width_==0 && entry.height_==0 && entry.bpp_==0){
+    // Oldest frame found captured after the deadline, no newer one is taken
+    bool hasTooNew = false;
+    u32 tooNew = 0;
+    // A pin of the head frame only fails after the producer has moved head_ on, so this terminates
+    for(;;) {
+        if(!recoverRing()) {
             return Status::Fail;
         }
-        if(syncTimeout<(lastSyncTime-currentTime)){
-            for(size_t i = 0; i < header_->maxFrames_; ++i) {
-                entries_[i].width_ = entries_[i].height_ = entries_[i].bpp_ = 0;
+        u32 head = cursor.head_.load(std::memory_order_acquire);
+        u32 tail = header_->tail_.load(std::memory_order_acquire);
+        Status status = Status::Success;
+        u32 sequence = head;
+        bool isNewestFirst = ReadPolicy::Queue != policy_;
+        if(isNewestFirst) {
+            // The newest published frame, everything before it is skipped
+            sequence = hasTooNew ? tooNew - 1 : tail - 1;
+        }
+        if(ReadPolicy::Buffered == policy_ && !hasTooNew && head != tail) {
+            // Frames behind the target depth are left for the next reads, which then need not wait for the producer
+            sequence -= targetDepth_;
+            if(static_cast<s32>(sequence - head) < 0) {
+                sequence = head;
             }
-            return Status::SyncTimeout;
         }
+        bool isOlder = isNewestFirst ? 0 < static_cast<s32>(tooNew - head) : 0 < static_cast<s32>(head - tooNew);
+        if(hasTooNew && head != tail && !isOlder) {
+            if(hasLastFrame_) {
+                // Every queued frame is due later, the same as an empty ring until then
+                tail = head;
+            } else {
+                // Nothing older to show, the oldest is due the soonest
+                deadline = NoDeadline;
+                sequence = head;
+            }
+        }
+        if(head == tail) {
+            //Have no last frames
+            if(!hasLastFrame_) {
+                addSharedCounter(stats_->empty_);
+                return Status::Fail;
+            }
+            if(syncTimeout < (currentTime - lastSyncTime)) {
+                hasLastFrame_ = false;
+                addSharedCounter(stats_->syncTimeouts_);
+                return Status::SyncTimeout;
+            }
+            status = Status::RepeatLastFrame;
+            sequence = lastSequence_;
+        }
+
+        Entry& entry = slot(sequence);
+        if(!pin(entry, sequence)) {
+            if(Status::RepeatLastFrame == status) {
+                // The writer is reusing the slot of the last frame, only a single frame ring or an aborted write does this
+                return Status::Fail;
+            }
+            if(0 < static_cast<s32>(sequence - entry.sequence_)) {
+                // Published into the ring of an earlier generation, this ring never held the frame
+                cursor.head_.compare_exchange_strong(head, sequence + 1, std::memory_order_acq_rel);
+            }
+            continue;
+        }
+        if(Status::Success == status && deadline < entry.timestamp_) {
+            // Due at a later deadline
+            unpin(entry);
+            hasTooNew = true;
+            tooNew = sequence;
+            continue;
+        }
+        if(Status::Success == status) {
+            // Failure means the producer dropped a frame, but this one is pinned and still intact
+            u32 next = sequence + 1;
+            while(static_cast<s32>(next - head) > 0) {
+                if(cursor.head_.compare_exchange_weak(head, next, std::memory_order_acq_rel)) {
+                    if(head != sequence) {
+                        addCounter(cursor.skipped_, sequence - head);
+                        addSharedCounter(stats_->skipped_, sequence - head);
+                    }
+                    notifySlotFree(cursor.head_);
+                    break;
+                }
+            }
+            // Pixels of a run of duplicates which began at or before the last read need no copy
+            if(0 != (entry.flags_ & FrameFlag_Duplicate) && hasLastFrame_
+               && 0 <= static_cast<s32>(lastSequence_ - entry.sameAs_) && 0 < static_cast<s32>(sequence - lastSequence_)) {
+                status = Status::RepeatLastFrame;
+            }
+        }
+        view.data_ = &data_[entry.offset_];
+        view.width_ = entry.width_;
+        view.height_ = entry.height_;
+        view.bpp_ = entry.bpp_;
+        view.pitch_ = entry.bpp_ * entry.width_;
+        view.sequence_ = sequence;
+        view.format_ = entry.format_;
+        view.flags_ = entry.flags_;
+        view.frameNumber_ = entry.frameNumber_;
+        view.timestamp_ = entry.timestamp_;
+
+        readStartTime_ = getMonotonicTime();
+        if(Status::Success == status) {
+            addSharedCounter(stats_->popped_);
+            if(view.timestamp_ < readStartTime_) {
+                stats_->latency_.recordShared(readStartTime_ - view.timestamp_);
+            }
+        } else {
+            addSharedCounter(stats_->repeats_);
+        }
+        hasLastFrame_ = true;
+        lastSequence_ = sequence;
+        return status;
     }
+}
 
-    width = entry.width_;
-    height = entry.height_;
-    bpp = entry.bpp_;
-    u32 size = (std::min)(bpp * width * height, dstSize);
-    memcpy(dst, &data_[entry.offset_], size);
+void VCamPipe::release(ReadView& view)
+{
+    if(nullptr == view.data_) {
+        return;
+    }
+    unpin(slot(view.sequence_));
+    stats_->readTime_.recordShared(getMonotonicTime() - readStartTime_);
+    view = {};
+}
 
-    if(1<=header_->size_){
-        header_->head_ = next(header_->head_);
-        header_->size_ -= 1;
-        return Status::Success;
+bool VCamPipe::getChangedTiles(u64* tiles, const ReadView& view, u32 previousSequence)
+{
+    memset(tiles, 0, sizeof(u64) * TileWords);
+    if(nullptr == header_ || nullptr == view.data_) {
+        return false;
     }
-    return Status::RepeatLastFrame;
+    u32 count = view.sequence_ - previousSequence;
+    if(ring_->maxFrames_ < count) {
+        return false;
+    }
+    // Each frame has the tiles changed from the one before, frames in between are pinned to read them
+    for(u32 sequence = previousSequence + 1; sequence - previousSequence <= count; ++sequence) {
+        Entry& entry = slot(sequence);
+        if(!pin(entry, sequence)) {
+            return false;
+        }
+        bool known = 0 != (entry.flags_ & FrameFlag_Delta) && entry.width_ == view.width_ && entry.height_ == view.height_ && entry.format_ == view.format_;
+        for(u32 i = 0; known && i < TileWords; ++i) {
+            tiles[i] |= entry.tiles_[i];
+        }
+        unpin(entry);
+        if(!known) {
+            return false;
+        }
+    }
+    return true;
 }
 
-u32 VCamPipe::getPageSize()
+bool VCamPipe::pin(Entry& entry, u32 sequence)
 {
-    SYSTEM_INFO systemInfo;
-    GetSystemInfo(&systemInfo);
-    return systemInfo.dwPageSize;
+    u32 state = entry.state_.load(std::memory_order_relaxed);
+    do {
+        if(SlotWriting & state) {
+            return false;
+        }
+    } while(!entry.state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed));
+    if(entry.sequence_ != sequence) {
+        unpin(entry);
+        return false;
+    }
+    return true;
+}
+
+void VCamPipe::unpin(Entry& entry)
+{
+    entry.state_.fetch_sub(1, std::memory_order_release);
+    notifySlotFree(entry.state_);
+}
+
+void VCamPipe::notifySlotFree(std::atomic<u32>& word)
+{
+    // Pairs with the increment of writeWaiters_ in waitSlot, either the writer sees the change or this sees the writer
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(0 < header_->writeWaiters_.load(std::memory_order_relaxed)) {
+        slotEvent_.notify(word);
+    }
+}
+
+bool VCamPipe::waitSlot(u32 tail)
+{
+    Entry& entry = slot(tail);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(header_->blockTimeout_);
+    for(;;) {
+        Cursor* slowest = nullptr;
+        u32 head = getSlowestHead(tail, slowest);
+        u32 state = entry.state_.load(std::memory_order_acquire);
+        bool isFull = ring_->maxFrames_ <= (tail - head);
+        if(!isFull && 0 == state) {
+            return true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(deadline <= now) {
+            return false;
+        }
+        u32 remaining = static_cast<u32>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        // A full ring waits for the head_ of the slowest reader to move, a pinned slot for its readers to leave
+        std::atomic<u32>& word = isFull ? slowest->head_ : entry.state_;
+        u32 expected = isFull ? head : state;
+        header_->writeWaiters_.fetch_add(1, std::memory_order_seq_cst);
+        if(expected == word.load(std::memory_order_seq_cst)) {
+            slotEvent_.wait(word, expected, remaining);
+        }
+        header_->writeWaiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+u64 VCamPipe::getControlSize()
+{
+    return roundUpPages(sizeof(Header) + sizeof(Cursor) * MaxReaders + sizeof(PipeStats));
+}
+
+u64 VCamPipe::layoutRing(RingHeader& ring, u32 maxFrames, u32 sizePerFrame, bool largePages)
+{
+    // Slots on page boundaries keep a frame off pages of its neighbours, and rows of SIMD copies aligned
+    u64 alignment = largePages ? getLargePageSize() : getPageSize();
+    ring.maxFrames_ = maxFrames;
+    ring.sizePerFrame_ = sizePerFrame;
+    ring.largePages_ = largePages ? 1 : 0;
+    ring.slotSize_ = roundUpPages(sizePerFrame);
+    ring.dataOffset_ = roundUp(sizeof(RingHeader) + sizeof(Entry) * maxFrames, alignment);
+    return roundUp(ring.dataOffset_ + ring.slotSize_ * maxFrames, alignment);
+}
+
+bool VCamPipe::reserve(u32 maxFrames, u32 sizePerFrame)
+{
+    if(nullptr == header_ || readOnly_ || !recoverRing()) {
+        return false;
+    }
+    if(maxFrames <= ring_->maxFrames_ && sizePerFrame <= ring_->sizePerFrame_) {
+        return true;
+    }
+    // Another side may grow the ring meanwhile, which may be enough
+    u32 state = lockSegment();
+    bool reserved = attachRing();
+    if(reserved && (ring_->maxFrames_ < maxFrames || ring_->sizePerFrame_ < sizePerFrame)) {
+        reserved = growRing((std::max)(ring_->maxFrames_, maxFrames), (std::max)(ring_->sizePerFrame_, sizePerFrame));
+    }
+    header_->state_.store(state, std::memory_order_release);
+    return reserved;
+}
+
+bool VCamPipe::attachRing()
+{
+    u32 generation = header_->generation_.load(std::memory_order_acquire);
+    if(nullptr != ring_ && generation == ring_->generation_) {
+        return true;
+    }
+    // Frames of the ring before are gone with it
+    hasLastFrame_ = false;
+    ring_ = nullptr;
+    entries_ = nullptr;
+    data_ = nullptr;
+    ringMemory_.close();
+    char name[96];
+    getRingName(name, sizeof(name), channel_, generation);
+    if(!ringMemory_.open(name, false, true)) {
+        return false;
+    }
+    const RingHeader* ring = reinterpret_cast<const RingHeader*>(ringMemory_.data());
+    if(ringMemory_.size() < sizeof(RingHeader) || generation != ring->generation_
+       || ringMemory_.size() < ring->dataOffset_ + ring->slotSize_ * ring->maxFrames_) {
+        ringMemory_.close();
+        return false;
+    }
+    mapRing();
+    return true;
+}
+
+bool VCamPipe::recoverRing()
+{
+    if(attachRing()) {
+        return true;
+    }
+    // On Win32 a ring lives as long as a side maps it, one grown by a side which exited before anyone else mapped it is gone.
+    // The next generation takes its place, as a side which grows the ring would make it.
+    // A ring which exists but fails to map keeps its frames, regrowing would drop them for every side
+    u32 state = lockSegment();
+    bool attached = attachRing();
+    if(!attached && SegmentReady == state && 0 < header_->maxFrames_) {
+        char name[96];
+        getRingName(name, sizeof(name), channel_, header_->generation_.load(std::memory_order_acquire));
+        if(!SharedMemory::exists(name)) {
+            attached = growRing(header_->maxFrames_, header_->sizePerFrame_);
+        }
+    }
+    header_->state_.store(state, std::memory_order_release);
+    return attached;
+}
+
+bool VCamPipe::growRing(u32 maxFrames, u32 sizePerFrame)
+{
+    if(maxFrames <= 0) {
+        return false;
+    }
+    maxFrames = roundUpPowerOfTwo(maxFrames);
+    // The mapping of this side is kept by this side, so the new ring outlives this call on Win32
+    hasLastFrame_ = false;
+    ring_ = nullptr;
+    entries_ = nullptr;
+    data_ = nullptr;
+    ringMemory_.close();
+    u32 previous = header_->generation_.load(std::memory_order_relaxed);
+    u32 generation = previous + 1;
+    char name[96];
+    getRingName(name, sizeof(name), channel_, generation);
+    // Large pages only pay off once the frames span several of them
+    RingHeader layout = {};
+    u64 largePageSize = getLargePageSize();
+    bool largePages = 0 < largePageSize && largePageSize <= layoutRing(layout, maxFrames, sizePerFrame, false);
+    u64 size = layoutRing(layout, maxFrames, sizePerFrame, largePages);
+    if(!ringMemory_.create(name, size, largePages)) {
+        return false;
+    }
+    // The last reader or writer removes the name, see detach
+    ringMemory_.setOwner(false);
+    RingHeader* ring = new(ringMemory_.data()) RingHeader(layout);
+    ring->generation_ = generation;
+    mapRing();
+    u32 tail = header_->tail_.load(std::memory_order_acquire);
+    for(u32 i = 0; i < maxFrames; ++i) {
+        new(&entries_[i]) Entry();
+        entries_[i].state_.store(0, std::memory_order_relaxed);
+        entries_[i].sequence_ = tail - UnwrittenDistance;
+        entries_[i].complete_ = 0;
+        entries_[i].offset_ = i * ring->slotSize_;
+    }
+    header_->maxFrames_ = maxFrames;
+    header_->sizePerFrame_ = sizePerFrame;
+    header_->generation_.store(generation, std::memory_order_seq_cst);
+
+    // Nobody finds the ring before any more, the sides which mapped it keep it until they move on
+    getRingName(name, sizeof(name), channel_, previous);
+    SharedMemory::remove(name);
+    return true;
+}
+
+u32 VCamPipe::getHeartbeat()
+{
+    return static_cast<u32>(getMonotonicTime() / 1000000);
+}
+
+u32 VCamPipe::lockSegment()
+{
+    // Readers hold the lock for a few stores, one which holds it for StaleTimeout has died while setting up
+    u32 state = lockState(header_->state_, SegmentLocked, StaleTimeout);
+    return SegmentLocked == state ? SegmentEmpty : state;
+}
+
+VCamPipe::Directory* VCamPipe::lockDirectory(SharedMemory& memory)
+{
+    if(!memory.create(VCamePipeDirectoryName, (std::max)(static_cast<u64>(getPageSize()), static_cast<u64>(sizeof(Directory))))) {
+        return nullptr;
+    }
+    // Channels keep their names while no pipe is open
+    memory.setOwner(false);
+    Directory* directory = reinterpret_cast<Directory*>(memory.data());
+    lockState(directory->state_, SegmentLocked, StaleTimeout);
+    return directory;
+}
+
+u32 VCamPipe::findChannel(const char* name, bool add)
+{
+    size_t length = nullptr == name ? 0 : strlen(name);
+    if(length <= 0 || MaxChannelName <= length) {
+        return NoChannel;
+    }
+    SharedMemory memory;
+    Directory* directory = lockDirectory(memory);
+    if(nullptr == directory) {
+        return NoChannel;
+    }
+    u32 channel = NoChannel;
+    u32 unnamed = NoChannel;
+    for(u32 i = 0; i < MaxChannels && NoChannel == channel; ++i) {
+        if(0 == strcmp(directory->names_[i], name)) {
+            channel = i;
+        } else if(NoChannel == unnamed && '\0' == directory->names_[i][0]) {
+            unnamed = i;
+        }
+    }
+    if(NoChannel == channel && add && NoChannel != unnamed) {
+        memcpy(directory->names_[unnamed], name, length + 1);
+        channel = unnamed;
+    }
+    directory->state_.store(0, std::memory_order_release);
+    return channel;
+}
+
+bool VCamPipe::getChannelName(u32 channel, char* name, u32 size)
+{
+    if(MaxChannels <= channel || size <= 0) {
+        return false;
+    }
+    SharedMemory memory;
+    Directory* directory = lockDirectory(memory);
+    if(nullptr == directory) {
+        return false;
+    }
+    snprintf(name, size, "%s", directory->names_[channel]);
+    directory->state_.store(0, std::memory_order_release);
+    return '\0' != name[0];
+}
+
+bool VCamPipe::claimCursor()
+{
+    // A free cursor first, a stale one may still belong to a paused reader
+    const u32 Claimable[] = {CursorFree, CursorStale};
+    for(u32 claimable: Claimable) {
+        for(u32 i = 0; i < MaxReaders; ++i) {
+            Cursor& cursor = cursors_[i];
+            u32 state = claimable;
+            if(!cursor.state_.compare_exchange_strong(state, CursorClaimed, std::memory_order_acquire, std::memory_order_relaxed)) {
+                continue;
+            }
+            if(nullptr != cursor_) {
+                frameEvents_[cursorIndex_].close();
+            }
+            if(!openFrameEvent(frameEvents_[i], channel_, i)) {
+                cursor.state_.store(claimable, std::memory_order_release);
+                return false;
+            }
+            owner_ = ++header_->nextOwner_;
+            cursor.owner_.store(owner_, std::memory_order_relaxed);
+            cursor.head_.store(header_->tail_.load(std::memory_order_acquire), std::memory_order_relaxed);
+            cursor.heartbeat_.store(getHeartbeat(), std::memory_order_relaxed);
+            cursor.skipped_.store(0, std::memory_order_relaxed);
+            cursor.overflows_.store(0, std::memory_order_relaxed);
+            cursor.policy_ = policy_;
+            cursor.targetDepth_ = targetDepth_;
+            cursor.state_.store(CursorActive, std::memory_order_release);
+            cursor_ = &cursor;
+            cursorIndex_ = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VCamPipe::registerReader()
+{
+    lockSegment();
+    bool claimed = claimCursor();
+    header_->state_.store(SegmentReady, std::memory_order_release);
+    return claimed;
+}
+
+void VCamPipe::releaseCursor()
+{
+    if(nullptr == cursor_) {
+        return;
+    }
+    // Claimed first, so neither the writer nor a new reader changes the cursor while its owner is checked
+    u32 state = cursor_->state_.load(std::memory_order_relaxed);
+    while((CursorActive == state || CursorStale == state)
+          && !cursor_->state_.compare_exchange_weak(state, CursorClaimed, std::memory_order_acquire, std::memory_order_relaxed)) {
+    }
+    if(CursorActive == state || CursorStale == state) {
+        bool isOwner = owner_ == cursor_->owner_.load(std::memory_order_relaxed);
+        cursor_->state_.store(isOwner ? CursorFree : state, std::memory_order_release);
+    }
+    cursor_ = nullptr;
+}
+
+void VCamPipe::detach()
+{
+    if(nullptr == cursor_ && !writer_) {
+        return;
+    }
+    u32 state = lockSegment();
+    releaseCursor();
+    if(writer_) {
+        --header_->writers_;
+        writer_ = false;
+    }
+    // The last reader or writer removes the names, the others leave the pipe to it, so a writer never pushes into a removed segment
+    bool isLast = 0 == header_->writers_;
+    for(u32 i = 0; i < MaxReaders; ++i) {
+        isLast = isLast && CursorFree == cursors_[i].state_.load(std::memory_order_acquire);
+    }
+    header_->state_.store(state, std::memory_order_release);
+    memory_.setOwner(isLast);
+    ringMemory_.setOwner(isLast);
+}
+
+bool VCamPipe::touchCursor()
+{
+    if(nullptr == cursor_) {
+        return false;
+    }
+    cursor_->heartbeat_.store(getHeartbeat(), std::memory_order_relaxed);
+    u32 state = cursor_->state_.load(std::memory_order_acquire);
+    if(CursorActive == state && owner_ == cursor_->owner_.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    if(CursorStale == state && cursor_->state_.compare_exchange_strong(state, CursorClaimed, std::memory_order_acquire, std::memory_order_relaxed)) {
+        if(owner_ == cursor_->owner_.load(std::memory_order_relaxed)) {
+            // The writer no longer kept the frames of this reader, rejoin at the newest one
+            cursor_->head_.store(header_->tail_.load(std::memory_order_acquire), std::memory_order_relaxed);
+            cursor_->state_.store(CursorActive, std::memory_order_release);
+            return true;
+        }
+        cursor_->state_.store(CursorStale, std::memory_order_release);
+    }
+    // Another reader took over the cursor while this one was stale
+    return registerReader();
+}
+
+u32 VCamPipe::getSlowestHead(u32 tail, Cursor*& slowest)
+{
+    slowest = nullptr;
+    u32 head = tail;
+    u32 now = getHeartbeat();
+    for(u32 i = 0; i < MaxReaders; ++i) {
+        Cursor& cursor = cursors_[i];
+        u32 state = cursor.state_.load(std::memory_order_acquire);
+        if(CursorActive != state) {
+            continue;
+        }
+        // Signed, a reader may have stored a heartbeat after now was taken
+        if(static_cast<s32>(StaleTimeout) < static_cast<s32>(now - cursor.heartbeat_.load(std::memory_order_relaxed))) {
+            if(cursor.state_.compare_exchange_strong(state, CursorStale, std::memory_order_relaxed)) {
+                addCounter(stats_->staleReaders_);
+            }
+            continue;
+        }
+        u32 cursorHead = cursor.head_.load(std::memory_order_acquire);
+        if(tail - head < tail - cursorHead) {
+            head = cursorHead;
+            slowest = &cursor;
+        }
+    }
+    return head;
+}
+
+VCamPipe::Entry& VCamPipe::slot(u32 counter)
+{
+    return entries_[counter % ring_->maxFrames_];
+}
+
+bool VCamPipe::isComplete(u32 sequence, u32 width, u32 height, PixelFormat format, u32 flags)
+{
+    const Entry& entry = slot(sequence);
+    return 0 != entry.complete_ && entry.sequence_ == sequence && entry.width_ == width && entry.height_ == height && entry.format_ == format
+           && (entry.flags_ & FrameFlag_TopDown) == (flags & FrameFlag_TopDown);
+}
+
+void VCamPipe::map()
+{
+    header_ = reinterpret_cast<Header*>(mapped_);
+    cursors_ = reinterpret_cast<Cursor*>(mapped_ + sizeof(Header));
+    u8* stats = mapped_ + sizeof(Header) + sizeof(Cursor) * MaxReaders;
+    stats_ = reinterpret_cast<PipeStats*>(stats);
 }
 
-u32 VCamPipe::next(u32 current) const
+void VCamPipe::mapRing()
 {
-    ++current;
-    return header_->maxFrames_ <= current ? 0 : current;
+    u8* ring = ringMemory_.data();
+    ring_ = reinterpret_cast<RingHeader*>(ring);
+    entries_ = reinterpret_cast<Entry*>(ring + sizeof(RingHeader));
+    data_ = ring + ring_->dataOffset_;
 }
 
 } // namespace vcam
\ No newline at end of file
@@ -57,20 +57,34 @@ For more information, please refer to <http://unlicense.org>
 /**
 @author t-sakai
 */
-#    include <Windows.h>
-#    include <cstdint>
+#    include "VCamConvert.h"
+#    include "VCamPlatform.h"
+#    include "VCamStats.h"
+#    include <atomic>
 namespace vcam
 {
-using s8 = int8_t;
-using s32 = int32_t;
-using s64 = int64_t;
-
-using u8 = uint8_t;
-using u32 = uint32_t;
-using u64 = uint64_t;
 
 /**
  * @brief Named pipe implementation by using shared memory
+ *
+ * The frame buffer is a lock-free single-producer ring broadcast to up to MaxReaders readers.
+ * The writer owns one monotonic counter and every reader a cursor with its own, and every slot carries a small state word
+ * which the writer sets while filling it and readers increment while copying from it,
+ * so no side ever holds a lock during a copy. A reader never takes frames from another one.
+ * The writer reuses a slot once the slowest active reader has passed it, a reader which stops reading for StaleTimeout
+ * is declared stale and no longer counts until it reads again.
+ * Each of MaxChannels channels is a pipe in a segment of its own, so producers of different channels never contend.
+ * Channels are selected by index, or by name through a channel directory in shared memory.
+ *
+ * The control segment of a channel holds the header, cursors and statistics, the ring of slots and frames is a segment
+ * sized for the frames really streamed. A side which needs larger slots or more of them creates the ring of the next
+ * generation and publishes it in the header, every side moves to it before its next slot or read.
+ * Frames left in the ring before are dropped. On Win32 a ring lives only while a side maps it, so a side which finds
+ * the published ring gone grows the next generation in its place.
+ * The names of the segments are removed by the last reader or writer to leave.
+ * Control blocks of the producer and of each consumer sit on cache lines of their own, and so does each slot's entry.
+ * Frame slots start on page boundaries, and a ring of at least a large page is backed by large pages where the OS allows,
+ * with its slots starting on a large page.
  */
 class VCamPipe
 {
@@ -78,22 +92,76 @@ public:
     VCamPipe();
     ~VCamPipe();
 
+    static constexpr u32 MaxReaders = 8;      //!< Number of reader cursors in shared memory
+    static constexpr u32 StaleTimeout = 2000; //!< Milliseconds without reads after which a reader is declared stale
+    static constexpr u32 MaxChannels = 4;     //!< Number of channels, one camera each
+    static constexpr u32 MaxChannelName = 32; //!< Bytes of a channel name with the terminator
+    static constexpr u32 NoChannel = ~0U;     //!< Returned by findChannel if not found
+
     /**
      * @brief Open as a reader. A reader retrieves frame data in Direct Show filtering process.
+     *
+     * The first reader creates the pipe, later ones register a cursor in the live pipe and keep its format and ring,
+     * which grows if it is smaller than sizePerFrame. Without registered readers, the pipe takes the format,
+     * and its ring is set up again if it differs.
      * @param width [in] ... Pixel width
      * @param height [in] ... Pixel height
      * @param bpp [in] ... Bytes per pixel
-     * @param maxFrames [in] ... Maximum frames in frame buffer
-     * @param sizePerFrame [in] ... Maximum size per frame in bytes
-     * @return true if succeeded
+     * @param maxFrames [in] ... Maximum frames in frame buffer, rounded up to a power of two
+     * @param sizePerFrame [in] ... Maximum size per frame in bytes, the negotiated format is enough as the ring grows for larger ones
+     * @param channel [in] ... Channel, less than MaxChannels
+     * @return true if succeeded, false if every cursor is taken
      */
-    bool openRead(u32 width, u32 height, u32 bpp, u32 maxFrames, u32 sizePerFrame);
+    bool openRead(u32 width, u32 height, u32 bpp, u32 maxFrames, u32 sizePerFrame, u32 channel = 0);
 
     /**
      * @brief Open as a writer. A writer publishes frame data from another process.
+     * @param channel [in] ... Channel, less than MaxChannels
+     * @return true if succeeded
+     */
+    bool openWrite(u32 channel = 0);
+
+    /**
+     * @brief Open read-only to watch a pipe, only getFormat, getSkippedFrames, getReaders and getStats work
+     * @param channel [in] ... Channel, less than MaxChannels
      * @return true if succeeded
      */
-    bool openWrite();
+    bool openMonitor(u32 channel = 0);
+
+    /**
+     * @return Channel opened
+     */
+    u32 getChannel() const
+    {
+        return channel_;
+    }
+
+    /**
+     * @brief Look up a channel by name in the channel directory
+     * @param name [in] ... Channel name, at most MaxChannelName - 1 bytes
+     * @param add [in] ... Assign a channel of no name to a new name
+     * @return Channel, or NoChannel if the name is not found or every channel has a name
+     */
+    static u32 findChannel(const char* name, bool add = true);
+
+    /**
+     * @brief Retrieve the name of a channel from the channel directory
+     * @param channel [in] ... Channel
+     * @param name [out] ... Channel name
+     * @param size [in] ... Capacity of name, MaxChannelName is enough
+     * @return false if the channel has no name
+     */
+    static bool getChannelName(u32 channel, char* name, u32 size);
+
+    /**
+     * @brief Grow the ring to hold at least maxFrames frames of sizePerFrame bytes, as a reader or writer
+     *
+     * A larger ring is a new generation, which every side moves to. Not while a slot or a view is held.
+     * @param maxFrames [in] ... Number of slots, rounded up to a power of two
+     * @param sizePerFrame [in] ... Size per frame in bytes
+     * @return true if the ring is large enough
+     */
+    bool reserve(u32 maxFrames, u32 sizePerFrame);
 
     /**
      * @return true if connected
@@ -132,15 +200,141 @@ public:
     void setFormat(u32 width, u32 height, u32 bpp);
 
     /**
-     * @brief Push a frame into ring buffer
+     * @brief Flags of a frame
+     */
+    enum FrameFlag : u32
+    {
+        FrameFlag_None = 0,
+        FrameFlag_TopDown = 0x01U, //!< The first row in memory is the top row, otherwise bottom-up as a DIB or glReadPixels
+        FrameFlag_Delta = 0x02U,   //!< Set by pushDelta, the frame knows which tiles changed from the previous one
+        FrameFlag_Duplicate = 0x04U, //!< Set by push and pushDelta, the pixels are the same as the previous frame
+    };
+
+    static constexpr u32 TileSize = 64;  //!< Pixel width and height of a tile of pushDelta
+    static constexpr u32 MaxTiles = 4096; //!< Frames of more tiles are always copied as a whole
+    static constexpr u32 TileWords = MaxTiles / 64;
+    static constexpr u64 NoDeadline = ~0ULL; //!< peekRead takes any frame regardless of its capture time
+
+    /**
+     * @brief Area of a frame in pixels, y goes down from the top row
+     */
+    struct Rect
+    {
+        u32 x_;
+        u32 y_;
+        u32 width_;
+        u32 height_;
+    };
+
+    /**
+     * @brief Push a frame into ring buffer, copying it from a caller buffer
+     *
+     * The frame is bottom-up, BGR24 if bpp is 3 and BGRA32 if bpp is 4.
+     * The copy also hashes the frame, a frame of the same hash as the previous one is flagged FrameFlag_Duplicate.
      * @param width ... Pixel width
      * @param height ... Pixel height
      * @param bpp ... Bytes per pixel
      * @param data ... frame data
-     * @param timeout ... Timeout in milliseconds for locking
-     * @return true if succeeded
+     * @param timeout ... Reserved, OverflowPolicy::Block waits as long as setOverflowPolicy tells
+     * @return true if succeeded, false if the frame is too large, its slot is still being read, or the overflow policy drops it
+     */
+    bool push(u32 width, u32 height, u32 bpp, const u8* data, u32 timeout = 4);
+
+    /**
+     * @brief Push a frame of a pixel format, the reader converts it to the negotiated format
+     * @param width ... Pixel width
+     * @param height ... Pixel height
+     * @param format ... Pixel format
+     * @param flags ... FrameFlag bits
+     * @param data ... frame data
+     * @return true if succeeded, false if the frame is too large, its slot is still being read, or the overflow policy drops it
+     */
+    bool push(u32 width, u32 height, PixelFormat format, u32 flags, const u8* data);
+
+    /**
+     * @brief Push a frame of which only some areas changed since the previous push
+     *
+     * Tiles overlapping rects are copied from data, other tiles are carried forward from the previous frame, and only if the slot holds an older one.
+     * Without rects, tiles are compared with the previous frame to find the changed ones.
+     * A frame of another size or format than the previous one is copied as a whole.
+     * @param width ... Pixel width
+     * @param height ... Pixel height
+     * @param format ... Pixel format, RGB only
+     * @param flags ... FrameFlag bits
+     * @param data ... frame data
+     * @param rects ... Changed areas, or nullptr to compare tiles
+     * @param numRects ... Number of rects
+     * @return true if succeeded, false if the frame is too large or its slot is still being read
+     */
+    bool pushDelta(u32 width, u32 height, PixelFormat format, u32 flags, const u8* data, const Rect* rects, u32 numRects);
+
+    /**
+     * @return Number of tile columns of a frame width
+     */
+    static u32 getTileColumns(u32 width)
+    {
+        return (width + TileSize - 1) / TileSize;
+    }
+
+    /**
+     * @return Number of tile rows of a frame height
      */
-    bool push(u32 width, u32 height, u32 bpp, u8* data, u32 timeout = 4);
+    static u32 getTileRows(u32 height)
+    {
+        return (height + TileSize - 1) / TileSize;
+    }
+
+    /**
+     * @brief Slot in shared memory reserved for one frame by acquireWriteSlot
+     */
+    struct WriteSlot
+    {
+        u8* data_;        //!< First row of the frame, write pixels here
+        u32 pitch_;       //!< Bytes per row
+        u32 capacity_;    //!< Writable bytes from data_
+        u32 sequence_;    //!< Counter value of the frame
+        u64 frameNumber_; //!< Number of the frame, one more than the last commit, may be overwritten before commit
+        u64 timestamp_;   //!< Capture time by getMonotonicTime at acquireWriteSlot, may be overwritten before commit
+    };
+
+    /**
+     * @brief Reserve the next slot of the ring buffer to render a frame into it directly
+     *
+     * The slot is invisible to the reader until commit. Call commit or abort before acquiring another slot.
+     * A frame larger than the slots grows the ring.
+     * @param slot [out] ... Reserved slot
+     * @param width [in] ... Pixel width
+     * @param height [in] ... Pixel height
+     * @param bpp [in] ... Bytes per pixel
+     * @return true if succeeded, false if the ring cannot grow for the frame or its slot is still being read
+     */
+    bool acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, u32 bpp);
+
+    /**
+     * @brief Reserve the next slot for a frame of a pixel format
+     * @param slot [out] ... Reserved slot
+     * @param width [in] ... Pixel width
+     * @param height [in] ... Pixel height
+     * @param format [in] ... Pixel format
+     * @param flags [in] ... FrameFlag bits
+     * @return true if succeeded, false if the ring cannot grow for the frame or its slot is still being read
+     */
+    bool acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, PixelFormat format, u32 flags);
+
+    /**
+     * @brief Publish a slot reserved by acquireWriteSlot
+     *
+     * Frame numbers of later frames continue from slot.frameNumber_.
+     * The frame is dropped if another side replaced the ring meanwhile.
+     */
+    void commit(WriteSlot& slot);
+
+    /**
+     * @brief Give back a slot reserved by acquireWriteSlot without publishing it
+     *
+     * If the ring was full, the oldest frame has already been dropped for the slot.
+     */
+    void abort(WriteSlot& slot);
 
     enum class Status
     {
@@ -151,7 +345,101 @@ public:
     };
 
     /**
-     * @brief Pop a frame from ring buffer
+     * @brief Which queued frame the reader takes
+     */
+    enum class ReadPolicy : u32
+    {
+        Queue = 0, //!< The oldest one, every frame is shown but the output lags by the queued ones
+        Latest,    //!< The newest one as a mailbox, older ones are skipped without copying
+        Buffered,  //!< The newest one which leaves the target depth of frames queued, a jitter buffer against bursts
+    };
+
+    /**
+     * @brief What the writer does when the ring is full
+     */
+    enum class OverflowPolicy : u32
+    {
+        DropOldest = 0, //!< Overwrite the oldest queued frame, the reader never holds the writer back
+        DropNewest,     //!< Fail to acquire, the frame being written is dropped and the queued ones are kept
+        Block,          //!< Sleep until the reader frees a slot, then drop the frame being written if it times out
+    };
+
+    static constexpr u32 DefaultBlockTimeout = 100; //!< Milliseconds OverflowPolicy::Block waits by default
+
+    /**
+     * @brief Select the overflow policy, as either a writer or a reader
+     *
+     * Lossless pipelines, such as recording, use OverflowPolicy::Block with ReadPolicy::Queue and run at the pace of the reader.
+     * @param policy [in] ... Overflow policy
+     * @param timeout [in] ... Milliseconds acquireWriteSlot and push wait for a slot under OverflowPolicy::Block
+     */
+    void setOverflowPolicy(OverflowPolicy policy, u32 timeout = DefaultBlockTimeout);
+
+    /**
+     * @return Current overflow policy
+     */
+    OverflowPolicy getOverflowPolicy() const;
+
+    /**
+     * @brief Select the read policy of this reader
+     */
+    void setReadPolicy(ReadPolicy policy);
+
+    /**
+     * @return Read policy of this reader
+     */
+    ReadPolicy getReadPolicy() const;
+
+    /**
+     * @brief Set the frames ReadPolicy::Buffered keeps queued behind the one read by this reader
+     * @param depth [in] ... Number of frames, at most getMaxFrames() - 2 so the writer and the pinned frame keep their slots
+     */
+    void setTargetDepth(u32 depth);
+
+    /**
+     * @return Frames ReadPolicy::Buffered keeps queued
+     */
+    u32 getTargetDepth() const;
+
+    /**
+     * @return Number of slots of the ring buffer
+     */
+    u32 getMaxFrames() const;
+
+    /**
+     * @return Number of published frames this reader skipped under ReadPolicy::Latest or Buffered, every reader for a monitor
+     */
+    u32 getSkippedFrames() const;
+
+    /**
+     * @return Number of frames of this reader the producer dropped from a full ring, 0 for a monitor
+     */
+    u32 getOverflowedFrames() const;
+
+    /**
+     * @brief State of a registered reader
+     */
+    struct ReaderInfo
+    {
+        u32 index_;         //!< Cursor of the reader
+        bool stale_;        //!< Declared stale, the reader rejoins at the newest frame with its next read
+        ReadPolicy policy_; //!< Read policy
+        u32 targetDepth_;   //!< Frames ReadPolicy::Buffered keeps queued
+        u32 queued_;        //!< Published frames the reader has not taken yet
+        u32 skipped_;       //!< Frames the reader skipped
+        u32 overflowed_;    //!< Frames of the reader dropped from a full ring
+    };
+
+    /**
+     * @brief Retrieve registered readers
+     * @param readers [out] ... Readers
+     * @param maxReaders [in] ... Capacity of readers
+     * @return Number of readers stored
+     */
+    u32 getReaders(ReaderInfo* readers, u32 maxReaders) const;
+
+    /**
+     * @brief Pop a frame from ring buffer, copying it into a caller buffer
      * @param dst [out] ... Frame buffer for next data
      * @param dstSize [in] ... Buffer size of dst
      * @param width [out] ... Pixel width
@@ -160,82 +448,358 @@ public:
      * @param lastSyncTime ... Last succeeded time of retrieving data
      * @param currentTime ... Current time
      * @param syncTimeout ... Timeout for giving up to retrive data
-     * @param timeout ... Timeout in milliseconds for locking
+     * @param timeout ... Milliseconds to wait for a new frame before repeating the last one
      * @return Result status
      */
     Status pop(u8* dst, u32 dstSize, u32& width, u32& height, u32& bpp, s64 lastSyncTime, s64 currentTime, s64 syncTimeout, u32 timeout = 4);
 
-private:
-    VCamPipe(const VCamPipe&) = delete;
-    VCamPipe& operator=(const VCamPipe&) = delete;
+    /**
+     * @brief Sleep until the writer publishes a frame the reader has not taken yet
+     *
+     * The writer signals only readers which wait, so an idle reader costs it nothing.
+     * @param milliseconds [in] ... Longest wait
+     * @return true if a frame is available, false if timed out
+     */
+    bool waitFrame(u32 milliseconds);
 
     /**
-     * @brief Automatic realeasing utility of mutex.
+     * @brief Read-only view of a frame in shared memory, returned by peekRead
      */
-    struct Lock
+    struct ReadView
     {
-        Lock(HANDLE& handle)
-            : handle_(handle)
-        {
-        }
+        const u8* data_; //!< First row of the frame
+        u32 width_;      //!< Pixel width
+        u32 height_;     //!< Pixel height
+        u32 bpp_;        //!< Bytes per pixel
+        u32 pitch_;      //!< Bytes per row
+        u32 sequence_;   //!< Counter value of the frame
+        PixelFormat format_; //!< Pixel format
+        u32 flags_;          //!< FrameFlag bits
+        u64 frameNumber_;    //!< Number of the frame, a gap means frames were lost
+        u64 timestamp_;      //!< Capture time in nanoseconds of getMonotonicTime
+    };
 
-        ~Lock()
-        {
-            ReleaseMutex(handle_);
-        }
+    /**
+     * @brief Borrow the next frame from ring buffer without copying it
+     *
+     * Same as pop, but the frame stays in shared memory and is pinned against the writer until release.
+     * A duplicate of the frame read last time is returned as Status::RepeatLastFrame, with FrameFlag_Duplicate in flags_.
+     * Hold at most one view at a time and release it quickly, the writer cannot reuse its slot meanwhile.
+     * Release it before the next peekRead, which moves to a new generation of the ring.
+     * Frames captured after deadline are left for a later read, the newest older one is taken under ReadPolicy::Latest,
+     * otherwise the last frame is repeated. Before any frame was read, an early frame is better than none.
+     * @param view [out] ... Borrowed frame, valid if Success or RepeatLastFrame
+     * @param lastSyncTime ... Last succeeded time of retrieving data
+     * @param currentTime ... Current time
+     * @param syncTimeout ... Timeout for giving up to retrive data
+     * @param deadline [in] ... Due time of the frame in nanoseconds of getMonotonicTime
+     * @return Result status
+     */
+    Status peekRead(ReadView& view, s64 lastSyncTime, s64 currentTime, s64 syncTimeout, u64 deadline = NoDeadline);
 
-        DWORD Wait(u32 timeout)
-        {
-            return WaitForSingleObject(handle_, timeout);
-        }
-        HANDLE& handle_;
-    };
+    /**
+     * @brief Give back a frame borrowed by peekRead
+     */
+    void release(ReadView& view);
+
+    /**
+     * @brief Find the tiles which changed between a frame read before and a borrowed frame
+     *
+     * Bit x + y * getTileColumns(view.width_) is tile x, y, with tile rows in memory order of the frame.
+     * @param tiles [out] ... TileWords words
+     * @param view [in] ... Frame borrowed by peekRead
+     * @param previousSequence [in] ... sequence_ of the frame read before
+     * @return false if unknown, then the whole frame is to be treated as changed
+     */
+    bool getChangedTiles(u64* tiles, const ReadView& view, u32 previousSequence);
+
+    /**
+     * @return Statistics in shared memory, nullptr if not connected
+     */
+    PipeStats* getStats()
+    {
+        return stats_;
+    }
 
     /**
-     * @return Page size
+     * @return Statistics in shared memory, nullptr if not connected
      */
-    static u32 getPageSize();
+    const PipeStats* getStats() const
+    {
+        return stats_;
+    }
+
+private:
+    VCamPipe(const VCamPipe&) = delete;
+    VCamPipe& operator=(const VCamPipe&) = delete;
+
+    static constexpr u32 CacheLineSize = 64;
+    static constexpr u32 SlotWriting = 0x80000000U; //!< Slot state bit set while the writer fills a slot
+
+    // States of Header::state_, a new segment is zero filled
+    static constexpr u32 SegmentEmpty = 0;  //!< Not set up yet
+    static constexpr u32 SegmentLocked = 1; //!< A reader sets up the segment or registers
+    static constexpr u32 SegmentReady = 2;  //!< Set up
+
+    // States of Cursor::state_
+    static constexpr u32 CursorFree = 0;    //!< No reader
+    static constexpr u32 CursorClaimed = 1; //!< Being registered or released, ignored by the writer
+    static constexpr u32 CursorActive = 2;  //!< The writer keeps the frames of the reader
+    static constexpr u32 CursorStale = 3;   //!< Declared stale by the writer, which no longer keeps its frames
 
     /**
      * @brief Shared video and stream information
+     *
+     * The counters increase monotonically and wrap around, a slot is selected by counter modulo the ring's maxFrames_,
+     * a power of two so the selection carries on over the wrap.
+     * They carry on over generations of the ring.
+     * The first cache line is set up by readers and read by everyone, the producer counters live on their own cache line.
      */
     struct Header
     {
+        std::atomic<u32> state_; //!< Segment state, readers register and rings grow under SegmentLocked
         u32 width_;        //!< Pixel width
         u32 height_;       //!< Pixel height
         u32 bpp_;          //!< Bytes per pixel
-        u32 maxFrames_;    //!< Maximum frames in ring buffer
-        u32 size_;         //!< Ring buffer item count
-        u32 head_;         //!< Ring buffer head
-        u32 tail_;         //!< Ring buffer tail
-        u32 sizePerFrame_; //!< Maximum size of frame in bytes
+        std::atomic<u32> generation_; //!< Generation of the current ring, published after the ring is set up
+        u32 maxFrames_;    //!< Maximum frames in the current ring, for monitors which do not map it
+        u32 sizePerFrame_; //!< Maximum size of frame in bytes of the current ring
+        OverflowPolicy overflow_; //!< What the producer does when the ring is full
+        u32 blockTimeout_;        //!< Milliseconds OverflowPolicy::Block waits
+        u32 nextOwner_;           //!< Ticket of the next registered reader, written under SegmentLocked
+        u32 writers_;             //!< Writers attached, written under SegmentLocked, names outlive the last reader while any is
+
+        alignas(CacheLineSize) std::atomic<u32> tail_; //!< Count of published frames, written by the producer
+        u64 frameNumber_;                              //!< Number of the next frame, written by the producer
+        std::atomic<u32> writeWaiters_;                //!< Number of writers waiting for a slot, readers signal only if not zero
+    };
+    static_assert(0 == sizeof(Header) % CacheLineSize, "Cursors start on a cache line of their own");
+
+    /**
+     * @brief Start of a ring segment, which never changes once published
+     *
+     * Entries follow, then the slots from dataOffset_, every slotSize_ bytes.
+     */
+    struct alignas(CacheLineSize) RingHeader
+    {
+        u32 generation_;   //!< Generation, part of the segment name
+        u32 maxFrames_;    //!< Number of slots, a power of two
+        u32 sizePerFrame_; //!< Capacity of a slot in bytes
+        u32 largePages_;   //!< 1 if the slots are aligned to large pages
+        u64 slotSize_;     //!< Distance between slots, sizePerFrame_ rounded up to pages
+        u64 dataOffset_;   //!< Offset of the first slot, aligned to a page or a large page
+    };
+
+    /**
+     * @brief Names of channels, in a segment of its own which is never removed
+     */
+    struct Directory
+    {
+        std::atomic<u32> state_;                  //!< SegmentLocked while a name is looked up or added
+        char names_[MaxChannels][MaxChannelName]; //!< Name of each channel, empty if none
+    };
+
+    /**
+     * @brief Read position of a registered reader, on its own cache line
+     */
+    struct Cursor
+    {
+        alignas(CacheLineSize) std::atomic<u32> state_; //!< Cursor state
+        std::atomic<u32> owner_;     //!< Ticket of the reader holding the cursor, a reader which finds another one has lost it
+        std::atomic<u32> head_;      //!< Count of frames consumed by the reader, the producer advances it only to drop the oldest frame
+        std::atomic<u32> waiters_;   //!< Number of threads of the reader in waitFrame, the producer signals only if not zero
+        std::atomic<u32> heartbeat_; //!< Milliseconds of getMonotonicTime at the last read or wait of the reader
+        std::atomic<u32> skipped_;   //!< Count of frames skipped by ReadPolicy::Latest or Buffered
+        std::atomic<u32> overflows_; //!< Count of frames the producer dropped from a full ring before the reader took them
+        ReadPolicy policy_;          //!< Read policy of the reader
+        u32 targetDepth_;            //!< Frames ReadPolicy::Buffered keeps queued
     };
 
     /**
-     * @brief Entry of ring buffer
+     * @brief Entry of ring buffer, on cache lines of its own so pinning a slot does not disturb its neighbours
      */
-    struct Entry
+    struct alignas(CacheLineSize) Entry
     {
-        u32 width_;  //!< Pixel width
-        u32 height_; //!< Pixel height
-        u32 bpp_;    //!< Bytes per pixel
+        std::atomic<u32> state_; //!< SlotWriting while being written, otherwise the number of readers
+        u32 sequence_;           //!< Counter value of the frame held in this slot
+        u32 width_;              //!< Pixel width
+        u32 height_;             //!< Pixel height
+        u32 bpp_;                //!< Bytes per pixel
+        PixelFormat format_;     //!< Pixel format
+        u32 flags_;              //!< FrameFlag bits
+        u32 complete_;           //!< 1 if the slot holds every pixel of the frame sequence_, 0 while written or after abort
+        u32 sameAs_;             //!< Counter value of the first frame of a run of identical frames
         u32 padding_;
-        u64 offset_; //!< Offet of raw data
+        u64 offset_;      //!< Offet of raw data from the first slot
+        u64 frameNumber_; //!< Number of the frame
+        u64 timestamp_;   //!< Capture time in nanoseconds of getMonotonicTime
+        u64 hash_;        //!< copyHash of the pixels, 0 if unknown
+        u64 tiles_[TileWords]; //!< Tiles changed from the frame before, valid with FrameFlag_Delta
     };
+    static_assert(std::atomic<u32>::is_always_lock_free, "Shared atomics must be lock-free");
+
+    /**
+     * @brief Pin a slot against the writer
+     * @param entry [in] ... Slot
+     * @param sequence [in] ... Expected counter value of the frame in the slot
+     * @return true if the slot is pinned and holds the expected frame
+     */
+    bool pin(Entry& entry, u32 sequence);
+
+    /**
+     * @brief Release a pinned slot
+     */
+    void unpin(Entry& entry);
 
     /**
-     * @brief Move a cursor in ring buffer
-     * @param current [in] ... Current cursor position
-     * @return Next cursor position
+     * @return Size in bytes of the control segment
      */
-    u32 next(u32 current) const;
+    static u64 getControlSize();
+
+    /**
+     * @brief Lay out a ring segment
+     * @param ring [out] ... Layout of the ring
+     * @param largePages [in] ... Align the slots to large pages
+     * @return Size in bytes of the ring segment
+     */
+    static u64 layoutRing(RingHeader& ring, u32 maxFrames, u32 sizePerFrame, bool largePages);
+
+    /**
+     * @return Milliseconds of getMonotonicTime for heartbeats, which wrap around
+     */
+    static u32 getHeartbeat();
+
+    /**
+     * @brief Map the channel directory, creating it if needed, and lock it
+     * @return Directory, nullptr if failed
+     */
+    static Directory* lockDirectory(SharedMemory& memory);
+
+    /**
+     * @brief Take Header::state_ as SegmentLocked
+     * @return Previous state, SegmentEmpty if a holder died while setting up
+     */
+    u32 lockSegment();
+
+    /**
+     * @brief Map the ring of the current generation if not mapped yet, dropping the ring before
+     * @return false if no ring is mapped
+     */
+    bool attachRing();
+
+    /**
+     * @brief attachRing, and if no ring of the current generation exists any longer, grow the next generation in its place
+     * @return false if no ring is mapped
+     */
+    bool recoverRing();
+
+    /**
+     * @brief Create and map the ring of the next generation and publish it, under SegmentLocked
+     * @return true if succeeded
+     */
+    bool growRing(u32 maxFrames, u32 sizePerFrame);
+
+    /**
+     * @brief Claim a free or stale cursor and open its frame event, under SegmentLocked
+     * @return true if succeeded
+     */
+    bool claimCursor();
+
+    /**
+     * @brief Register this reader again, after its cursor was taken over by another one
+     */
+    bool registerReader();
+
+    /**
+     * @brief Give back the cursor of this reader, under SegmentLocked
+     */
+    void releaseCursor();
+
+    /**
+     * @brief Leave the pipe as a reader or writer, the last side of either removes the names
+     */
+    void detach();
+
+    /**
+     * @brief Update the heartbeat of this reader, and rejoin at the newest frame if declared stale
+     * @return false if no cursor is available
+     */
+    bool touchCursor();
+
+    /**
+     * @brief Find the slowest active reader as the writer, declaring readers stale which have not read for StaleTimeout
+     * @param tail [in] ... Count of published frames
+     * @param slowest [out] ... Cursor of the slowest reader, nullptr if none
+     * @return Head of the slowest reader, tail if none
+     */
+    u32 getSlowestHead(u32 tail, Cursor*& slowest);
+
+    /**
+     * @brief Wake a writer waiting for a slot, after word changed
+     */
+    void notifySlotFree(std::atomic<u32>& word);
+
+    /**
+     * @brief Sleep until the slot of tail is neither queued nor pinned, as the writer under OverflowPolicy::Block
+     * @return false if timed out
+     */
+    bool waitSlot(u32 tail);
+
+    /**
+     * @brief Select the slot of a counter value
+     */
+    Entry& slot(u32 counter);
+
+    /**
+     * @brief Whether a slot holds every pixel of a frame of a format and row order, only for the producer
+     */
+    bool isComplete(u32 sequence, u32 width, u32 height, PixelFormat format, u32 flags);
+
+    /**
+     * @brief Copy a frame into an acquired slot with its hash, flag it if the previous frame has the same one, and commit
+     */
+    void copyAndCommit(WriteSlot& slot, const u8* data, u32 size);
+
+    /**
+     * @brief Flag a frame being written as a duplicate of the previous frame
+     */
+    void setDuplicate(Entry& entry, const Entry& previous);
+
+    /**
+     * @brief Point header_, cursors_ and stats_ into mapped_
+     */
+    void map();
+
+    /**
+     * @brief Point ring_, entries_ and data_ into ringMemory_
+     */
+    void mapRing();
+
+    bool acquireWriteSlot(WriteSlot& slot, u32 width, u32 height, PixelFormat format, u32 bpp, u32 flags);
 
-    HANDLE mutex_ = nullptr;
-    HANDLE file_ = nullptr;
+    SharedMemory memory_;
+    SharedMemory ringMemory_;           //!< Ring of the generation this side uses
+    WordEvent frameEvents_[MaxReaders]; //!< Signaled by commit when tail_ moves and a reader waits, one per cursor
+    WordEvent slotEvent_;               //!< Signaled by readers when a head_ moves or a slot is unpinned and a writer waits
     u8* mapped_ = nullptr;
     Header* header_ = nullptr;
-    Entry* entries_ = nullptr;
+    Cursor* cursors_ = nullptr;  //!< MaxReaders cursors, follow header_
+    PipeStats* stats_ = nullptr; //!< Follows cursors_
+    RingHeader* ring_ = nullptr; //!< Start of ringMemory_
+    Entry* entries_ = nullptr;   //!< Follow ring_
     u8* data_ = nullptr;
+    u32 channel_ = 0;           //!< Channel opened
+    Cursor* cursor_ = nullptr;  //!< Cursor of this reader, nullptr unless opened by openRead
+    u32 cursorIndex_ = 0;       //!< Index of cursor_
+    u32 owner_ = 0;             //!< Ticket of this reader in cursor_
+    ReadPolicy policy_ = ReadPolicy::Queue; //!< Read policy of this reader, cursor_ has a copy for monitors
+    u32 targetDepth_ = 0;                   //!< Target depth of this reader, cursor_ has a copy for monitors
+    bool readOnly_ = false;     //!< Opened by openMonitor
+    bool writer_ = false;       //!< Opened by openWrite, counted in Header::writers_
+    bool hasLastFrame_ = false; //!< Whether lastSequence_ can be repeated
+    u32 lastSequence_ = 0;      //!< Counter value of the last retrieved frame
+    u64 writeStartTime_ = 0;    //!< When the acquired slot was reserved
+    u64 readStartTime_ = 0;     //!< When the borrowed frame was read
 };
 } // namespace vcam
 #endif // INC_VCAM_PIPE_H_
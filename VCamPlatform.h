@@ -0,0 +1,227 @@
+﻿#pragma once
+#ifndef INC_VCAM_PLATFORM_H_
+#    define INC_VCAM_PLATFORM_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include <atomic>
+#    include <cstdint>
+namespace vcam
+{
+using s8 = int8_t;
+using s16 = int16_t;
+using s32 = int32_t;
+using s64 = int64_t;
+
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
+
+/**
+ * @return Page size
+ */
+u32 getPageSize();
+
+/**
+ * @return Size of a large page, 0 if the OS gives none
+ */
+u64 getLargePageSize();
+
+/**
+ * @return Nanoseconds of a monotonic clock which every process on this machine shares
+ */
+u64 getMonotonicTime();
+
+/**
+ * @brief Sleep until getMonotonicTime reaches time, to well under a millisecond
+ * @param time [in] ... Absolute time of getMonotonicTime
+ */
+void sleepUntil(u64 time);
+
+/**
+ * @brief Named shared memory segment, OS dependent part of VCamPipe with WordEvent
+ *
+ * Win32 backs it with a named file mapping, POSIX with shm_open and mmap.
+ */
+class SharedMemory
+{
+public:
+    SharedMemory();
+    ~SharedMemory();
+
+    /**
+     * @brief Create a segment, or open the existing one with the same name
+     *
+     * With largePages, Win32 backs a new segment with large pages if the process may lock memory,
+     * and rounds size up to them. Linux asks for transparent huge pages. Otherwise small pages are used.
+     * @param name [in] ... Segment name
+     * @param size [in] ... Size in bytes
+     * @param largePages [in] ... Back the segment with large pages where the OS allows
+     * @return true if succeeded
+     */
+    bool create(const char* name, u64 size, bool largePages = false);
+
+    /**
+     * @brief Open an existing segment as a whole
+     * @param name [in] ... Segment name
+     * @param readOnly [in] ... Map without write access, for monitors
+     * @param largePages [in] ... Map with large pages where the OS allows, Win32 decides at create
+     * @return true if succeeded
+     */
+    bool open(const char* name, bool readOnly = false, bool largePages = false);
+
+    /**
+     * @brief Unmap and close the segment, the owner also removes its name
+     */
+    void close();
+
+    /**
+     * @brief Hand over removing the name on close, POSIX names outlive their users while Win32 ones do not
+     * @param owner [in] ... Whether this instance removes the name
+     */
+    void setOwner(bool owner);
+
+    /**
+     * @brief Remove the name of a segment, processes which mapped it keep it, Win32 names go with their last handle
+     * @param name [in] ... Segment name
+     */
+    static void remove(const char* name);
+
+    /**
+     * @brief Whether a segment of the name exists
+     * @param name [in] ... Segment name
+     * @return false only if no segment has the name, one which cannot be opened for other reasons exists
+     */
+    static bool exists(const char* name);
+
+    /**
+     * @return Mapped address, or nullptr if not opened
+     */
+    u8* data() const
+    {
+        return data_;
+    }
+
+    /**
+     * @return Mapped size in bytes
+     */
+    u64 size() const
+    {
+        return size_;
+    }
+
+private:
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+#    if defined(_WIN32)
+    void* handle_ = nullptr; //!< Handle of file mapping
+#    else
+    s32 fd_ = -1;        //!< Descriptor of shared memory object
+    bool owner_ = false; //!< Whether this instance removes the name, the creator until setOwner
+    char name_[64] = {}; //!< Name of shared memory object
+#    endif
+    u8* data_ = nullptr;
+    u64 size_ = 0;
+};
+
+/**
+ * @brief Wakeup of a thread in another process which waits for a word in shared memory to change
+ *
+ * Win32 uses a named auto-reset event, Linux a futex on the word itself, which needs no name.
+ * Other POSIX systems fall back to polling the word every millisecond.
+ * Wakeups may be spurious, callers check the word again.
+ */
+class WordEvent
+{
+public:
+    WordEvent();
+    ~WordEvent();
+
+    /**
+     * @brief Create the event, or open the existing one with the same name
+     * @param name [in] ... Event name
+     * @return true if succeeded
+     */
+    bool open(const char* name);
+
+    /**
+     * @brief Close the event
+     */
+    void close();
+
+    /**
+     * @brief Wake every thread waiting on word
+     */
+    void notify(std::atomic<u32>& word);
+
+    /**
+     * @brief Sleep while word holds expected, at most milliseconds
+     * @return false if timed out
+     */
+    bool wait(std::atomic<u32>& word, u32 expected, u32 milliseconds);
+
+private:
+    WordEvent(const WordEvent&) = delete;
+    WordEvent& operator=(const WordEvent&) = delete;
+
+#    if defined(_WIN32)
+    void* handle_ = nullptr; //!< Handle of event
+#    endif
+};
+} // namespace vcam
+#endif // INC_VCAM_PLATFORM_H_
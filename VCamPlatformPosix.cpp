@@ -0,0 +1,330 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamPlatform.h"
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#endif
+
+namespace vcam
+{
+u32 getPageSize()
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return 0 < pageSize ? static_cast<u32>(pageSize) : 0;
+}
+
+u64 getLargePageSize()
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // Huge pages of shared memory are transparent ones, of the size of a page middle directory entry
+    static const u64 largePageSize = [] {
+        // The selected mode is in brackets, as "always within_size advise [never] deny force", and never and deny keep shared memory in small pages
+        char mode[128] = {};
+        FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+        if(nullptr == file) {
+            return static_cast<u64>(0);
+        }
+        bool hasMode = nullptr != fgets(mode, sizeof(mode), file);
+        fclose(file);
+        if(!hasMode || nullptr != strstr(mode, "[never]") || nullptr != strstr(mode, "[deny]")) {
+            return static_cast<u64>(0);
+        }
+
+        unsigned long long size = 0;
+        file = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+        if(nullptr != file) {
+            if(1 != fscanf(file, "%llu", &size)) {
+                size = 0;
+            }
+            fclose(file);
+        }
+        return static_cast<u64>(size);
+    }();
+    return largePageSize;
+#else
+    return 0;
+#endif
+}
+
+namespace
+{
+    /**
+     * @brief Map a shared memory object, at an address aligned to large pages if asked for
+     *
+     * A huge page needs its virtual address aligned as well, so an aligned range is reserved first.
+     */
+    void* mapShared(s32 fd, u64 size, s32 protection, bool largePages)
+    {
+        u64 alignment = largePages ? getLargePageSize() : 0;
+        if(alignment <= 0) {
+            return mmap(nullptr, static_cast<size_t>(size), protection, MAP_SHARED, fd, 0);
+        }
+        size_t reserved = static_cast<size_t>(size + alignment);
+        void* range = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(MAP_FAILED == range) {
+            return range;
+        }
+        uintptr_t begin = reinterpret_cast<uintptr_t>(range);
+        uintptr_t aligned = (begin + alignment - 1) / alignment * alignment;
+        void* data = mmap(reinterpret_cast<void*>(aligned), static_cast<size_t>(size), protection, MAP_SHARED | MAP_FIXED, fd, 0);
+        if(MAP_FAILED == data) {
+            munmap(range, reserved);
+            return data;
+        }
+        // Give back the reserved range around the mapping
+        if(begin < aligned) {
+            munmap(range, aligned - begin);
+        }
+        uintptr_t end = aligned + static_cast<uintptr_t>(size);
+        if(end < begin + reserved) {
+            munmap(reinterpret_cast<void*>(end), begin + reserved - end);
+        }
+#if defined(MADV_HUGEPAGE)
+        // Only advice, shmem_enabled of transparent_hugepage decides
+        madvise(data, static_cast<size_t>(size), MADV_HUGEPAGE);
+#endif
+        return data;
+    }
+} // namespace
+
+u64 getMonotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<u64>(now.tv_sec) * 1000000000ULL + static_cast<u64>(now.tv_nsec);
+}
+
+void sleepUntil(u64 time)
+{
+    // An absolute deadline does not accumulate the oversleep of each call
+    struct timespec deadline;
+    deadline.tv_sec = static_cast<time_t>(time / 1000000000ULL);
+    deadline.tv_nsec = static_cast<long>(time % 1000000000ULL);
+    while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr)) {
+    }
+}
+
+SharedMemory::SharedMemory()
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    close();
+}
+
+bool SharedMemory::create(const char* name, u64 size, bool largePages)
+{
+    // POSIX shared memory names are a single path component
+    snprintf(name_, sizeof(name_), "/%s", name);
+    fd_ = shm_open(name_, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if(0 <= fd_) {
+        owner_ = true;
+    } else {
+        fd_ = shm_open(name_, O_RDWR, S_IRUSR | S_IWUSR);
+        if(fd_ < 0) {
+            return false;
+        }
+    }
+    // Same as CreateFileMapping, never shrink an existing segment
+    struct stat st = {};
+    if(0 != fstat(fd_, &st)) {
+        close();
+        return false;
+    }
+    if(static_cast<u64>(st.st_size) < size && 0 != ftruncate(fd_, static_cast<off_t>(size))) {
+        close();
+        return false;
+    }
+    void* data = mapShared(fd_, size, PROT_READ | PROT_WRITE, largePages);
+    if(MAP_FAILED == data) {
+        close();
+        return false;
+    }
+    data_ = reinterpret_cast<u8*>(data);
+    size_ = size;
+    return true;
+}
+
+bool SharedMemory::open(const char* name, bool readOnly, bool largePages)
+{
+    snprintf(name_, sizeof(name_), "/%s", name);
+    fd_ = shm_open(name_, readOnly ? O_RDONLY : O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd_ < 0) {
+        return false;
+    }
+    struct stat st = {};
+    if(0 != fstat(fd_, &st) || st.st_size <= 0) {
+        close();
+        return false;
+    }
+    s32 protection = readOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
+    void* data = mapShared(fd_, static_cast<u64>(st.st_size), protection, largePages);
+    if(MAP_FAILED == data) {
+        close();
+        return false;
+    }
+    data_ = reinterpret_cast<u8*>(data);
+    size_ = static_cast<u64>(st.st_size);
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if(nullptr != data_) {
+        munmap(data_, static_cast<size_t>(size_));
+        data_ = nullptr;
+    }
+    if(0 <= fd_) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    // Win32 removes a mapping with its last handle, POSIX needs the owner to remove the name
+    if(owner_) {
+        shm_unlink(name_);
+        owner_ = false;
+    }
+    size_ = 0;
+}
+
+void SharedMemory::setOwner(bool owner)
+{
+    owner_ = owner && 0 <= fd_;
+}
+
+void SharedMemory::remove(const char* name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/%s", name);
+    shm_unlink(path);
+}
+
+bool SharedMemory::exists(const char* name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/%s", name);
+    s32 fd = shm_open(path, O_RDONLY, 0);
+    if(fd < 0) {
+        return ENOENT != errno;
+    }
+    ::close(fd);
+    return true;
+}
+
+WordEvent::WordEvent()
+{
+}
+
+WordEvent::~WordEvent()
+{
+    close();
+}
+
+bool WordEvent::open(const char*)
+{
+    return true;
+}
+
+void WordEvent::close()
+{
+}
+
+#if defined(__linux__)
+// Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+static_assert(sizeof(std::atomic<u32>) == sizeof(u32), "A futex word is 32 bits");
+
+void WordEvent::notify(std::atomic<u32>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<u32*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bool WordEvent::wait(std::atomic<u32>& word, u32 expected, u32 milliseconds)
+{
+    struct timespec timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_nsec = static_cast<long>(milliseconds % 1000) * 1000000L;
+    // The kernel compares the word atomically with going to sleep, EAGAIN means it has changed already
+    long result = syscall(SYS_futex, reinterpret_cast<u32*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    return 0 == result || EAGAIN == errno || expected != word.load(std::memory_order_acquire);
+}
+#else
+void WordEvent::notify(std::atomic<u32>&)
+{
+}
+
+bool WordEvent::wait(std::atomic<u32>& word, u32 expected, u32 milliseconds)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    while(expected == word.load(std::memory_order_acquire)) {
+        if(deadline <= std::chrono::steady_clock::now()) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+#endif
+} // namespace vcam
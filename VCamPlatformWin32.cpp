@@ -0,0 +1,287 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamPlatform.h"
+#include <Windows.h>
+
+namespace vcam
+{
+u32 getPageSize()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+}
+
+u64 getLargePageSize()
+{
+    return GetLargePageMinimum();
+}
+
+namespace
+{
+    bool enableLockMemory()
+    {
+        // Large pages need SeLockMemoryPrivilege, which is granted by policy and enabled here once
+        static const bool enabled = [] {
+            HANDLE token = NULL;
+            if(!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+                return false;
+            }
+            TOKEN_PRIVILEGES privileges = {};
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+            bool result = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+                          && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && ERROR_SUCCESS == GetLastError();
+            CloseHandle(token);
+            return result;
+        }();
+        return enabled;
+    }
+} // namespace
+
+u64 getMonotonicTime()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    // Split to avoid overflowing 64 bits
+    u64 f = static_cast<u64>(frequency.QuadPart);
+    u64 c = static_cast<u64>(counter.QuadPart);
+    return (c / f) * 1000000000ULL + (c % f) * 1000000000ULL / f;
+}
+
+namespace
+{
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#    define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+    /**
+     * @brief High resolution waitable timer of a thread, null before Windows 10 1803
+     */
+    struct SleepTimer
+    {
+        SleepTimer()
+            : handle_(CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS))
+        {
+        }
+
+        ~SleepTimer()
+        {
+            if(NULL != handle_) {
+                CloseHandle(handle_);
+            }
+        }
+
+        HANDLE handle_;
+    };
+} // namespace
+
+void sleepUntil(u64 time)
+{
+    // The timer wakes up within half a millisecond, Sleep up to a scheduler tick late,
+    // so both stop short and yield for the rest
+    static thread_local SleepTimer timer;
+    const u64 Margin = NULL != timer.handle_ ? 500000ULL : 2000000ULL;
+    for(u64 now = getMonotonicTime(); now < time; now = getMonotonicTime()) {
+        u64 remaining = time - now;
+        if(Margin < remaining) {
+            LARGE_INTEGER dueTime;
+            // Negative is relative, in 100 nanoseconds
+            dueTime.QuadPart = -static_cast<LONGLONG>((remaining - Margin) / 100ULL);
+            if(NULL != timer.handle_ && SetWaitableTimer(timer.handle_, &dueTime, 0, NULL, NULL, FALSE)) {
+                WaitForSingleObject(timer.handle_, INFINITE);
+            } else {
+                Sleep(static_cast<DWORD>((remaining - Margin) / 1000000ULL));
+            }
+        } else {
+            SwitchToThread();
+        }
+    }
+}
+
+SharedMemory::SharedMemory()
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    close();
+}
+
+bool SharedMemory::create(const char* name, u64 size, bool largePages)
+{
+    u64 largePageSize = getLargePageSize();
+    if(largePages && 0 < largePageSize && enableLockMemory()) {
+        u64 largeSize = (size + largePageSize - 1) / largePageSize * largePageSize;
+        handle_ = CreateFileMappingA(
+            INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES, static_cast<DWORD>(largeSize >> 32), static_cast<DWORD>(largeSize), name);
+        // An existing mapping of small pages is mapped below as usual
+        bool isNew = nullptr != handle_ && ERROR_ALREADY_EXISTS != GetLastError();
+        if(isNew) {
+            data_ = reinterpret_cast<u8*>(MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(largeSize)));
+            if(nullptr != data_) {
+                size_ = largeSize;
+                return true;
+            }
+        }
+        close();
+    }
+    handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name);
+    if(nullptr == handle_) {
+        return false;
+    }
+    data_ = reinterpret_cast<u8*>(MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size)));
+    if(nullptr == data_) {
+        close();
+        return false;
+    }
+    size_ = size;
+    return true;
+}
+
+bool SharedMemory::open(const char* name, bool readOnly, bool)
+{
+    DWORD access = readOnly ? FILE_MAP_READ : (FILE_MAP_WRITE | FILE_MAP_READ);
+    handle_ = OpenFileMappingA(access, FALSE, name);
+    if(nullptr == handle_) {
+        return false;
+    }
+    data_ = reinterpret_cast<u8*>(MapViewOfFile(handle_, access, 0, 0, 0));
+    if(nullptr == data_) {
+        close();
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info = {};
+    VirtualQuery(data_, &info, sizeof(info));
+    size_ = info.RegionSize;
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if(nullptr != data_) {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if(nullptr != handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+    size_ = 0;
+}
+
+void SharedMemory::setOwner(bool)
+{
+    // The mapping goes away with its last handle
+}
+
+void SharedMemory::remove(const char*)
+{
+}
+
+bool SharedMemory::exists(const char* name)
+{
+    HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if(nullptr == handle) {
+        return ERROR_FILE_NOT_FOUND != GetLastError();
+    }
+    CloseHandle(handle);
+    return true;
+}
+
+WordEvent::WordEvent()
+{
+}
+
+WordEvent::~WordEvent()
+{
+    close();
+}
+
+bool WordEvent::open(const char* name)
+{
+    handle_ = CreateEventA(NULL, FALSE, FALSE, name);
+    return nullptr != handle_;
+}
+
+void WordEvent::close()
+{
+    if(nullptr != handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+}
+
+void WordEvent::notify(std::atomic<u32>&)
+{
+    if(nullptr != handle_) {
+        SetEvent(handle_);
+    }
+}
+
+bool WordEvent::wait(std::atomic<u32>& word, u32 expected, u32 milliseconds)
+{
+    if(expected != word.load(std::memory_order_acquire)) {
+        return true;
+    }
+    if(nullptr == handle_) {
+        Sleep(milliseconds);
+        return expected != word.load(std::memory_order_acquire);
+    }
+    // A notify before this wait leaves the event set, so it is never lost
+    return WAIT_OBJECT_0 == WaitForSingleObject(handle_, milliseconds);
+}
+} // namespace vcam
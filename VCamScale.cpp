@@ -0,0 +1,267 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamScale.h"
+#include "VCamConvertKernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vcam
+{
+namespace
+{
+    /**
+     * @brief Scale kernels of an instruction set
+     */
+    struct ScaleKernels
+    {
+        ScaleRowFunc scaleRow_;
+        BlendRowsFunc blendRows_;
+    };
+
+    const ScaleKernels ScaleKernelTable[static_cast<u32>(Isa::Num)] = {
+        {kernel::scaleRow, kernel::blendRows},
+#if VCAM_X86
+        {kernel::ssse3::scaleRow, kernel::ssse3::blendRows},
+        {kernel::ssse3::scaleRow, kernel::avx2::blendRows},
+#else
+        {},
+        {},
+#endif
+    };
+
+    u8 clamp255(s32 x)
+    {
+        return static_cast<u8>(x < 0 ? 0 : (255 < x ? 255 : x));
+    }
+
+    /**
+     * @brief Per thread buffers of Scaler::scale
+     */
+    struct Scratch
+    {
+        std::vector<u8> buffer_;
+        std::vector<s64> held_; //!< Source row in each slot of the ring, -1 if none
+        std::vector<const u8*> rows_;
+    };
+} // namespace
+
+Scaler::Scaler()
+    : dstWidth_(0)
+    , dstHeight_(0)
+    , srcWidth_(0)
+    , srcHeight_(0)
+    , srcFormat_(PixelFormat::Unknown)
+    , row_(nullptr)
+    , scaleRow_(nullptr)
+    , blendRows_(nullptr)
+    , x_{}
+    , y_{}
+{
+}
+
+bool Scaler::reset(u32 dstWidth, u32 dstHeight, u32 srcWidth, u32 srcHeight, PixelFormat srcFormat, ScaleFilter filter, Isa isa)
+{
+    dstWidth_ = dstHeight_ = srcWidth_ = srcHeight_ = 0;
+    if(dstWidth <= 0 || dstHeight <= 0 || srcWidth <= 0 || srcHeight <= 0 || 0 == getBytesPerPixel(srcFormat)) {
+        return false;
+    }
+    row_ = nullptr;
+    if(PixelFormat::BGRA32 != srcFormat) {
+        row_ = selectConvertRow(PixelFormat::BGRA32, srcFormat, isa);
+    }
+    s32 level = (std::min)(static_cast<s32>(isa), static_cast<s32>(Isa::Num) - 1);
+    for(; 0 < level && nullptr == ScaleKernelTable[level].scaleRow_; --level) {
+    }
+    scaleRow_ = ScaleKernelTable[level].scaleRow_;
+    blendRows_ = ScaleKernelTable[level].blendRows_;
+    setupAxis(x_, dstWidth, srcWidth, filter);
+    setupAxis(y_, dstHeight, srcHeight, filter);
+
+    dstWidth_ = dstWidth;
+    dstHeight_ = dstHeight;
+    srcWidth_ = srcWidth;
+    srcHeight_ = srcHeight;
+    srcFormat_ = srcFormat;
+    return true;
+}
+
+bool Scaler::matches(u32 dstWidth, u32 dstHeight, u32 srcWidth, u32 srcHeight, PixelFormat srcFormat) const
+{
+    return dstWidth == dstWidth_ && dstHeight == dstHeight_ && srcWidth == srcWidth_ && srcHeight == srcHeight_ && srcFormat == srcFormat_;
+}
+
+void Scaler::scale(const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd) const
+{
+    if(dstWidth_ <= 0) {
+        return;
+    }
+    rowEnd = (std::min)(rowEnd, dstHeight_);
+
+    // Horizontally resampled source rows stay in a ring of taps rows, source row r lives in slot r % taps
+    thread_local Scratch scratch;
+    const u32 taps = y_.taps_;
+    const size_t rowSize = static_cast<size_t>(dstWidth_) * 4;
+    scratch.buffer_.resize(rowSize * taps + static_cast<size_t>(srcWidth_) * 4);
+    scratch.held_.assign(taps, -1);
+    scratch.rows_.resize(taps);
+    u8* ring = scratch.buffer_.data();
+    u8* converted = ring + rowSize * taps;
+
+    for(u32 y = rowBegin; y < rowEnd; ++y) {
+        u32 offset = y_.offsets_[y];
+        for(u32 k = 0; k < taps; ++k) {
+            u32 srcRow = offset + k;
+            u32 index = srcRow % taps;
+            u8* slot = ring + rowSize * index;
+            if(scratch.held_[index] != srcRow) {
+                const u8* s = src.data_ + src.pitch_ * srcRow;
+                if(nullptr != row_) {
+                    row_(converted, s, srcWidth_);
+                    s = converted;
+                }
+                scaleRow_(slot, s, dstWidth_, x_.offsets_.data(), x_.weights_.data(), x_.taps_);
+                scratch.held_[index] = srcRow;
+            }
+            scratch.rows_[k] = slot;
+        }
+        blendRows_(dst.data_ + dst.pitch_ * y, scratch.rows_.data(), y_.weights_.data() + static_cast<size_t>(y) * taps, taps, 0, static_cast<u32>(rowSize));
+    }
+}
+
+void Scaler::setupAxis(Axis& axis, u32 dstSize, u32 srcSize, ScaleFilter filter)
+{
+    double scale = static_cast<double>(srcSize) / dstSize;
+    bool area = ScaleFilter::Area == filter || (ScaleFilter::Auto == filter && 1.0 < scale);
+
+    // Taps are the same for every destination, so that kernels run without branches
+    u32 taps = area ? static_cast<u32>(std::ceil(scale)) + 1 : 2;
+    taps = (std::min)(taps, srcSize);
+    axis.taps_ = taps;
+    axis.offsets_.resize(dstSize);
+    axis.weights_.assign(static_cast<size_t>(dstSize) * taps, 0);
+
+    std::vector<double> weights(static_cast<size_t>(std::ceil(scale)) + 3);
+    for(u32 i = 0; i < dstSize; ++i) {
+        s64 first = 0;
+        u32 count = 0;
+        if(area) {
+            double left = i * scale;
+            double right = (i + 1) * scale;
+            first = static_cast<s64>(std::floor(left));
+            for(s64 j = first; j < right && count < weights.size(); ++j) {
+                weights[count++] = ((std::min)(right, j + 1.0) - (std::max)(left, static_cast<double>(j))) / scale;
+            }
+        } else {
+            double center = (i + 0.5) * scale - 0.5;
+            first = static_cast<s64>(std::floor(center));
+            double t = center - first;
+            weights[0] = 1.0 - t;
+            weights[1] = t;
+            count = 2;
+        }
+
+        // Fold taps outside the source onto its edges, then place the window inside it
+        u32 offset = static_cast<u32>((std::max)(static_cast<s64>(0), (std::min)(first, static_cast<s64>(srcSize) - taps)));
+        s16* w = axis.weights_.data() + static_cast<size_t>(i) * taps;
+        s32 sum = 0;
+        s32 largest = 0;
+        for(u32 k = 0; k < count; ++k) {
+            s64 j = (std::max)(static_cast<s64>(0), (std::min)(first + k, static_cast<s64>(srcSize) - 1));
+            u32 index = static_cast<u32>(j - offset);
+            w[index] = static_cast<s16>(w[index] + std::lround(weights[k] * 16384.0));
+        }
+        for(u32 k = 0; k < taps; ++k) {
+            sum += w[k];
+            largest = w[largest] < w[k] ? static_cast<s32>(k) : largest;
+        }
+        // Rounding error goes to the largest weight, so flat areas stay flat
+        w[largest] = static_cast<s16>(w[largest] + 16384 - sum);
+        axis.offsets_[i] = offset;
+    }
+}
+
+namespace kernel
+{
+    void scaleRow(u8* dst, const u8* src, u32 width, const u32* offsets, const s16* weights, u32 taps)
+    {
+        for(u32 x = 0; x < width; ++x) {
+            const u8* p = src + offsets[x] * 4;
+            const s16* w = weights + static_cast<size_t>(x) * taps;
+            s32 sum[4] = {1 << 13, 1 << 13, 1 << 13, 1 << 13};
+            for(u32 k = 0; k < taps; ++k) {
+                sum[0] += w[k] * p[k * 4 + 0];
+                sum[1] += w[k] * p[k * 4 + 1];
+                sum[2] += w[k] * p[k * 4 + 2];
+                sum[3] += w[k] * p[k * 4 + 3];
+            }
+            dst[0] = clamp255(sum[0] >> 14);
+            dst[1] = clamp255(sum[1] >> 14);
+            dst[2] = clamp255(sum[2] >> 14);
+            dst[3] = clamp255(sum[3] >> 14);
+            dst += 4;
+        }
+    }
+
+    void blendRows(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end)
+    {
+        for(u32 i = begin; i < end; ++i) {
+            s32 sum = 1 << 13;
+            for(u32 k = 0; k < taps; ++k) {
+                sum += weights[k] * rows[k][i];
+            }
+            dst[i] = clamp255(sum >> 14);
+        }
+    }
+} // namespace kernel
+} // namespace vcam
@@ -0,0 +1,160 @@
+﻿#pragma once
+#ifndef INC_VCAM_SCALE_H_
+#    define INC_VCAM_SCALE_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamConvert.h"
+#    include <vector>
+
+namespace vcam
+{
+/**
+ * @brief Resampling filters of Scaler
+ */
+enum class ScaleFilter : u32
+{
+    Auto = 0, //!< Area along axes which shrink, bilinear along the others
+    Bilinear, //!< Two taps, sharp when enlarging but aliases below half size
+    Area,     //!< Box filter over the covered source pixels, for shrinking
+};
+
+/**
+ * @brief Resample a BGRA32 row horizontally
+ * @param dst [out] ... Destination pixels
+ * @param src [in] ... Source row
+ * @param width [in] ... Destination width
+ * @param offsets [in] ... First source pixel of each destination pixel
+ * @param weights [in] ... taps weights per destination pixel, 14 fractional bits summing to 1
+ * @param taps [in] ... Source pixels per destination pixel
+ */
+using ScaleRowFunc = void (*)(u8* dst, const u8* src, u32 width, const u32* offsets, const s16* weights, u32 taps);
+
+/**
+ * @brief Weighted sum of rows, byte by byte
+ * @param dst [out] ... Destination row
+ * @param rows [in] ... taps source rows
+ * @param weights [in] ... taps weights, 14 fractional bits summing to 1
+ * @param taps [in] ... Number of rows
+ * @param begin [in] ... First byte
+ * @param end [in] ... End of bytes
+ */
+using BlendRowsFunc = void (*)(u8* dst, const u8* const* rows, const s16* weights, u32 taps, u32 begin, u32 end);
+
+/**
+ * @brief Separable resampler from an RGB frame into a BGRA32 frame
+ *
+ * Coefficient tables are computed once by reset. Each source row is converted and resampled horizontally once,
+ * then destination rows blend a window of them, so any range of destination rows can run on its own thread.
+ */
+class Scaler
+{
+public:
+    Scaler();
+
+    /**
+     * @brief Compute coefficient tables
+     * @param dstWidth [in] ... Destination width
+     * @param dstHeight [in] ... Destination height
+     * @param srcWidth [in] ... Source width
+     * @param srcHeight [in] ... Source height
+     * @param srcFormat [in] ... RGB format of source
+     * @param filter [in] ... Filter
+     * @param isa [in] ... Highest instruction set to use
+     * @return false if sizes are zero or srcFormat is not RGB
+     */
+    bool reset(u32 dstWidth, u32 dstHeight, u32 srcWidth, u32 srcHeight, PixelFormat srcFormat, ScaleFilter filter, Isa isa);
+
+    /**
+     * @return Whether tables of the last reset are for these sizes and format
+     */
+    bool matches(u32 dstWidth, u32 dstHeight, u32 srcWidth, u32 srcHeight, PixelFormat srcFormat) const;
+
+    /**
+     * @brief Resample a range of destination rows, thread safe
+     * @param dst [out] ... BGRA32 destination of the sizes given to reset
+     * @param src [in] ... Source of the sizes and format given to reset
+     * @param rowBegin [in] ... First destination row
+     * @param rowEnd [in] ... End of destination rows
+     */
+    void scale(const Image& dst, const Image& src, u32 rowBegin, u32 rowEnd) const;
+
+private:
+    /**
+     * @brief Coefficients along an axis
+     */
+    struct Axis
+    {
+        u32 taps_;
+        std::vector<u32> offsets_;
+        std::vector<s16> weights_;
+    };
+
+    static void setupAxis(Axis& axis, u32 dstSize, u32 srcSize, ScaleFilter filter);
+
+    u32 dstWidth_;
+    u32 dstHeight_;
+    u32 srcWidth_;
+    u32 srcHeight_;
+    PixelFormat srcFormat_;
+    ConvertRowFunc row_; //!< Source to BGRA32, nullptr if already BGRA32
+    ScaleRowFunc scaleRow_;
+    BlendRowsFunc blendRows_;
+    Axis x_;
+    Axis y_;
+};
+} // namespace vcam
+#endif // INC_VCAM_SCALE_H_
@@ -0,0 +1,116 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+#include "VCamStats.h"
+
+namespace vcam
+{
+void StatHistogram::load(u32* bins) const
+{
+    for(u32 i = 0; i < NumBins; ++i) {
+        bins[i] = bins_[i].load(std::memory_order_relaxed);
+    }
+}
+
+u32 StatHistogram::getBin(u64 nanoseconds)
+{
+    if(nanoseconds < NumSubBins) {
+        return static_cast<u32>(nanoseconds);
+    }
+    u32 msb = 0;
+    for(u64 x = nanoseconds; 1 < x; x >>= 1) {
+        ++msb;
+    }
+    // The top bit selects a power of two, the next bits a quarter of it
+    u32 sub = static_cast<u32>(nanoseconds >> (msb - SubBinBits)) & (NumSubBins - 1);
+    u32 bin = (msb - SubBinBits + 1) * NumSubBins + sub;
+    return bin < NumBins ? bin : NumBins - 1;
+}
+
+u64 StatHistogram::getLowerBound(u32 bin)
+{
+    if(bin < NumSubBins) {
+        return bin;
+    }
+    u32 msb = bin / NumSubBins + SubBinBits - 1;
+    u64 sub = bin % NumSubBins;
+    return (NumSubBins + sub) << (msb - SubBinBits);
+}
+
+u64 StatHistogram::getPercentile(const u32* bins, double percentile)
+{
+    u64 total = 0;
+    for(u32 i = 0; i < NumBins; ++i) {
+        total += bins[i];
+    }
+    if(total <= 0) {
+        return 0;
+    }
+    double rank = percentile * 0.01 * static_cast<double>(total);
+    u64 count = 0;
+    for(u32 i = 0; i < NumBins; ++i) {
+        if(bins[i] <= 0) {
+            continue;
+        }
+        if(rank <= static_cast<double>(count + bins[i]) || i == NumBins - 1) {
+            u64 lower = getLowerBound(i);
+            u64 upper = i + 1 < NumBins ? getLowerBound(i + 1) : lower * 2;
+            double t = (rank - static_cast<double>(count)) / static_cast<double>(bins[i]);
+            t = t < 0.0 ? 0.0 : (1.0 < t ? 1.0 : t);
+            return lower + static_cast<u64>(t * static_cast<double>(upper - lower));
+        }
+        count += bins[i];
+    }
+    return 0;
+}
+} // namespace vcam
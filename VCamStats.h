@@ -0,0 +1,188 @@
+﻿#pragma once
+#ifndef INC_VCAM_STATS_H_
+#    define INC_VCAM_STATS_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamPlatform.h"
+#    include <atomic>
+namespace vcam
+{
+/**
+ * @brief Add to a counter which only one thread writes
+ *
+ * A plain load and store, other processes only read the counter, so no locked instruction is needed.
+ */
+inline void addCounter(std::atomic<u32>& counter, u32 count = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add to a counter which threads of several processes write, such as every reader of a pipe
+ */
+inline void addSharedCounter(std::atomic<u32>& counter, u32 count = 1)
+{
+    counter.fetch_add(count, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Log-linear histogram of durations in shared memory, written by one thread with record or by many with recordShared
+ *
+ * Every power of two of nanoseconds is split into four bins, so a percentile is within 25%.
+ * Bins are 32 bit and wrap around, monitors take the difference of two snapshots.
+ */
+class StatHistogram
+{
+public:
+    static constexpr u32 NumBins = 128;       //!< Covers up to about eight seconds
+    static constexpr u32 SubBinBits = 2;      //!< Bins per power of two as bits
+    static constexpr u32 NumSubBins = 1U << SubBinBits;
+
+    /**
+     * @brief Count one duration
+     * @param nanoseconds [in] ... Duration
+     */
+    void record(u64 nanoseconds)
+    {
+        addCounter(bins_[getBin(nanoseconds)]);
+    }
+
+    /**
+     * @brief Count one duration, from any of several writers
+     * @param nanoseconds [in] ... Duration
+     */
+    void recordShared(u64 nanoseconds)
+    {
+        addSharedCounter(bins_[getBin(nanoseconds)]);
+    }
+
+    /**
+     * @brief Copy the bins
+     * @param bins [out] ... NumBins counts
+     */
+    void load(u32* bins) const;
+
+    /**
+     * @param nanoseconds [in] ... Duration
+     * @return Bin of a duration
+     */
+    static u32 getBin(u64 nanoseconds);
+
+    /**
+     * @param bin [in] ... Bin
+     * @return Smallest duration in nanoseconds of a bin
+     */
+    static u64 getLowerBound(u32 bin);
+
+    /**
+     * @brief Estimate a percentile from copied bins, interpolating inside a bin
+     * @param bins [in] ... NumBins counts
+     * @param percentile [in] ... 0 to 100
+     * @return Duration in nanoseconds, 0 if there are no counts
+     */
+    static u64 getPercentile(const u32* bins, double percentile);
+
+private:
+    std::atomic<u32> bins_[NumBins];
+};
+
+/**
+ * @brief Statistics of a VCamPipe, mapped next to its header
+ *
+ * Each group is written by one side only and has its own cache lines.
+ * The producer group costs a few plain stores, the others are shared by every registered reader and use addSharedCounter.
+ * Counters are 32 bit and wrap around, because 64 bit atomics are not plain loads on 32 bit x86.
+ */
+struct PipeStats
+{
+    static constexpr u32 CacheLineSize = 64;
+
+    // Written by the producer
+    alignas(CacheLineSize) std::atomic<u32> pushed_; //!< Frames committed
+    std::atomic<u32> overflows_;                     //!< Oldest frames dropped because the ring was full
+    std::atomic<u32> writeBusy_;                     //!< Writes refused because a reader still pinned the slot
+    std::atomic<u32> staleReaders_;                  //!< Readers declared stale, which no longer held back the ring
+    std::atomic<u32> tilesCopied_;                   //!< Tiles written by pushDelta
+    std::atomic<u32> tilesSkipped_;                  //!< Tiles pushDelta left in place because the slot already held them
+    std::atomic<u32> duplicates_;                    //!< Frames pushed with the same pixels as the previous one
+    std::atomic<u32> rejected_;                      //!< Frames dropped by OverflowPolicy::DropNewest or a timeout of Block
+    std::atomic<u32> blocked_;                       //!< Acquires which waited for a slot under OverflowPolicy::Block
+    StatHistogram blockTime_;                        //!< Time waited for a slot
+    StatHistogram writeTime_;                        //!< From acquireWriteSlot to commit, the copy or render time
+
+    // Written by the consumers
+    alignas(CacheLineSize) std::atomic<u32> popped_; //!< Frames read for the first time
+    std::atomic<u32> skipped_;                       //!< Frames skipped by ReadPolicy::Latest or Buffered
+    std::atomic<u32> repeats_;                       //!< Reads of Status::RepeatLastFrame
+    std::atomic<u32> syncTimeouts_;                  //!< Reads of Status::SyncTimeout
+    std::atomic<u32> empty_;                         //!< Reads of Status::Fail before any frame
+    StatHistogram waitTime_;                         //!< Time slept in waitFrame
+    StatHistogram latency_;                          //!< From the capture time of a frame to its first read
+    StatHistogram readTime_;                         //!< From peekRead to release, the copy or conversion time
+
+    // Written by the Direct Show filters
+    alignas(CacheLineSize) std::atomic<u32> delivered_; //!< Samples filled
+    std::atomic<u32> dropped_;                          //!< Frames lost to ring overflow between delivered ones
+    std::atomic<u32> lateSamples_;                      //!< Frame deadlines passed while FillBuffer was blocked downstream
+    std::atomic<u32> samplesReused_;                    //!< Samples which already held the frame, copy and conversion skipped
+    std::atomic<u32> samplesPatched_;                   //!< Samples updated in the rows of changed tiles only
+    std::atomic<u32> rowsSkipped_;                      //!< Rows left in place by patched samples
+    StatHistogram fillTime_;                            //!< FillBuffer without waiting for a frame
+};
+static_assert(std::atomic<u32>::is_always_lock_free, "Shared atomics must be lock-free");
+} // namespace vcam
+#endif // INC_VCAM_STATS_H_
@@ -0,0 +1,239 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#include "VCamThreadPool.h"
+#include <cstdlib>
+
+namespace vcam
+{
+namespace
+{
+    u64 makeRange(u32 begin, u32 end)
+    {
+        return static_cast<u64>(begin) | (static_cast<u64>(end) << 32);
+    }
+
+    u32 getBegin(u64 range)
+    {
+        return static_cast<u32>(range);
+    }
+
+    u32 getEnd(u64 range)
+    {
+        return static_cast<u32>(range >> 32);
+    }
+} // namespace
+
+u32 ThreadPool::getDefaultNumWorkers()
+{
+    const char* value = std::getenv("VCAM_WORKERS");
+    if(nullptr != value && '\0' != value[0]) {
+        return static_cast<u32>(std::strtoul(value, nullptr, 10));
+    }
+    u32 concurrency = std::thread::hardware_concurrency();
+    u32 workers = 1 < concurrency ? concurrency - 1 : 0;
+    return workers < MaxDefaultWorkers ? workers : MaxDefaultWorkers;
+}
+
+ThreadPool::ThreadPool(u32 workers)
+    : ranges_(new Range[workers + 1])
+    , generation_(0)
+    , running_(0)
+    , quit_(false)
+    , task_(nullptr)
+    , context_(nullptr)
+{
+    for(u32 i = 0; i <= workers; ++i) {
+        ranges_[i].range_.store(0, std::memory_order_relaxed);
+    }
+    threads_.reserve(workers);
+    for(u32 i = 0; i < workers; ++i) {
+        threads_.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for(std::thread& thread: threads_) {
+        thread.join();
+    }
+}
+
+u32 ThreadPool::getNumWorkers() const
+{
+    return static_cast<u32>(threads_.size());
+}
+
+void ThreadPool::parallelFor(u32 count, Task task, void* context)
+{
+    if(count <= 0) {
+        return;
+    }
+    if(threads_.empty() || 1 == count) {
+        for(u32 i = 0; i < count; ++i) {
+            task(context, i);
+        }
+        return;
+    }
+    const u32 caller = static_cast<u32>(threads_.size());
+    const u64 threads = caller + 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = task;
+        context_ = context;
+        for(u32 i = 0; i <= caller; ++i) {
+            u32 begin = static_cast<u32>(count * i / threads);
+            u32 end = static_cast<u32>(count * (i + 1) / threads);
+            ranges_[i].range_.store(makeRange(begin, end), std::memory_order_relaxed);
+        }
+        running_ = caller;
+        ++generation_;
+    }
+    wake_.notify_all();
+    work(caller);
+
+    // Workers leave only after finishing the indices they took, so none of them runs once running_ reaches zero
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return 0 == running_; });
+}
+
+u32 ThreadPool::getBandRows(u32 rowBytes, u32 alignment)
+{
+    alignment = 0 < alignment ? alignment : 1;
+    u32 rows = 0 < rowBytes ? BandBytes / rowBytes : BandBytes;
+    rows = (rows / alignment) * alignment;
+    return rows < alignment ? alignment : rows;
+}
+
+void ThreadPool::run(u32 self)
+{
+    u32 generation = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, generation] { return quit_ || generation != generation_; });
+            if(quit_) {
+                return;
+            }
+            generation = generation_;
+        }
+        work(self);
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last = 0 == --running_;
+        }
+        if(last) {
+            done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::work(u32 self)
+{
+    u32 index;
+    while(pop(self, index) || steal(self, index)) {
+        task_(context_, index);
+    }
+}
+
+bool ThreadPool::pop(u32 self, u32& index)
+{
+    std::atomic<u64>& own = ranges_[self].range_;
+    u64 range = own.load(std::memory_order_acquire);
+    for(;;) {
+        u32 begin = getBegin(range);
+        u32 end = getEnd(range);
+        if(end <= begin) {
+            return false;
+        }
+        if(own.compare_exchange_weak(range, makeRange(begin + 1, end), std::memory_order_acq_rel)) {
+            index = begin;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal(u32 self, u32& index)
+{
+    const u32 threads = static_cast<u32>(threads_.size()) + 1;
+    for(u32 i = 1; i < threads; ++i) {
+        std::atomic<u64>& victim = ranges_[(self + i) % threads].range_;
+        u64 range = victim.load(std::memory_order_acquire);
+        for(;;) {
+            u32 begin = getBegin(range);
+            u32 end = getEnd(range);
+            if(end <= begin) {
+                break;
+            }
+            // Take the back half, the victim keeps working from the front
+            u32 split = end - (end - begin + 1) / 2;
+            if(victim.compare_exchange_weak(range, makeRange(begin, split), std::memory_order_acq_rel)) {
+                // Only the owner writes an empty range, thieves skip empty ones
+                ranges_[self].range_.store(makeRange(split + 1, end), std::memory_order_release);
+                index = split;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+} // namespace vcam
@@ -0,0 +1,176 @@
+﻿#pragma once
+#ifndef INC_VCAM_THREAD_POOL_H_
+#    define INC_VCAM_THREAD_POOL_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@author t-sakai
+*/
+#    include "VCamPlatform.h"
+#    include <atomic>
+#    include <condition_variable>
+#    include <memory>
+#    include <mutex>
+#    include <thread>
+#    include <vector>
+
+namespace vcam
+{
+/**
+ * @brief Persistent work-stealing worker threads which split frame operations into row bands
+ *
+ * parallelFor gives every thread, the caller included, a contiguous range of indices.
+ * A thread takes indices from the front of its own range, and once it runs dry it steals the back half of another one,
+ * so a worker which wakes late or runs on a busy core costs its share only once.
+ * Workers sleep between frames.
+ */
+class ThreadPool
+{
+public:
+    static constexpr u32 BandBytes = 128 * 1024;        //!< Target bytes per row band, with its source it stays in L2
+    static constexpr u32 MinParallelBytes = 1024 * 1024; //!< Frames smaller than this run on the calling thread
+    static constexpr u32 MaxDefaultWorkers = 7;          //!< Cap of getDefaultNumWorkers without VCAM_WORKERS
+
+    /**
+     * @brief Work of one band
+     * @param context [in] ... Pointer given to parallelFor
+     * @param index [in] ... Band index in [0, count)
+     */
+    using Task = void (*)(void* context, u32 index);
+
+    /**
+     * @return Value of environment variable VCAM_WORKERS if set, otherwise one less than the number of cores, at most MaxDefaultWorkers
+     */
+    static u32 getDefaultNumWorkers();
+
+    /**
+     * @param workers [in] ... Number of threads besides the caller of parallelFor, 0 runs everything on the caller
+     */
+    explicit ThreadPool(u32 workers);
+    ~ThreadPool();
+
+    /**
+     * @return Number of threads besides the caller of parallelFor
+     */
+    u32 getNumWorkers() const;
+
+    /**
+     * @brief Run task for every index in [0, count), return when all of them finished
+     */
+    void parallelFor(u32 count, Task task, void* context);
+
+    /**
+     * @brief Run func(index) for every index in [0, count), return when all of them finished
+     */
+    template<class T>
+    void parallelFor(u32 count, T& func)
+    {
+        parallelFor(count, [](void* context, u32 index) { (*static_cast<T*>(context))(index); }, &func);
+    }
+
+    /**
+     * @brief Split rows into bands of about BandBytes and run func(rowBegin, rowEnd) for each of them
+     * @param rows [in] ... Number of rows
+     * @param rowBytes [in] ... Bytes touched per row, source and destination
+     * @param alignment [in] ... Band heights are multiples of it
+     * @param func [in] ... Work of a band
+     */
+    template<class T>
+    void parallelRows(u32 rows, u32 rowBytes, u32 alignment, T& func)
+    {
+        if(static_cast<u64>(rows) * rowBytes < MinParallelBytes || threads_.empty()) {
+            func(0U, rows);
+            return;
+        }
+        u32 bandRows = getBandRows(rowBytes, alignment);
+        auto band = [&func, bandRows, rows](u32 index) {
+            u32 begin = index * bandRows;
+            func(begin, (rows - begin) < bandRows ? rows : begin + bandRows);
+        };
+        parallelFor((rows + bandRows - 1) / bandRows, band);
+    }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Indices left to a thread, begin in the lower and end in the upper 32 bits
+     */
+    struct alignas(64) Range
+    {
+        std::atomic<u64> range_;
+    };
+
+    static u32 getBandRows(u32 rowBytes, u32 alignment);
+
+    void run(u32 self);
+    void work(u32 self);
+    bool pop(u32 self, u32& index);
+    bool steal(u32 self, u32& index);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Range[]> ranges_; //!< One per worker, then one of the caller
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    u32 generation_;
+    u32 running_; //!< Workers inside the current job
+    bool quit_;
+
+    Task task_;
+    void* context_;
+};
+} // namespace vcam
+#endif // INC_VCAM_THREAD_POOL_H_
@@ -0,0 +1,155 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Throughput of every conversion kernel at every instruction set this CPU supports.
+
+Prints CSV, one line per kernel. GB/s counts bytes read plus bytes written.
+Each kernel is checked against the scalar kernel before it is timed.
+*/
+#include "VCamConvert.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+using namespace vcam;
+
+const char* getFormatName(PixelFormat format)
+{
+    switch(format) {
+    case PixelFormat::BGR24:
+        return "BGR24";
+    case PixelFormat::RGB24:
+        return "RGB24";
+    case PixelFormat::BGRA32:
+        return "BGRA32";
+    case PixelFormat::RGBA32:
+        return "RGBA32";
+    case PixelFormat::NV12:
+        return "NV12";
+    case PixelFormat::YUY2:
+        return "YUY2";
+    case PixelFormat::I420:
+        return "I420";
+    default:
+        return "Unknown";
+    }
+}
+
+struct Resolution
+{
+    u32 width_;
+    u32 height_;
+};
+} // namespace
+
+int main(int argc, char** argv)
+{
+    s32 iterations = 1 < argc ? atoi(argv[1]) : 50;
+    if(iterations <= 0) {
+        iterations = 1;
+    }
+    const PixelFormat Sources[] = {PixelFormat::BGR24, PixelFormat::RGB24, PixelFormat::BGRA32, PixelFormat::RGBA32};
+    const PixelFormat Destinations[] = {PixelFormat::BGR24, PixelFormat::BGRA32, PixelFormat::NV12, PixelFormat::YUY2, PixelFormat::I420};
+    // Odd widths exercise the scalar tails of SIMD kernels
+    const Resolution Resolutions[] = {{1920, 1080}, {3840, 2160}, {1366, 768}};
+
+    printf("src,dst,isa,width,height,ms_per_frame,gb_per_s,verified\n");
+    for(const Resolution& resolution: Resolutions) {
+        u32 width = resolution.width_;
+        u32 height = resolution.height_;
+        std::vector<u8> src(static_cast<size_t>(width) * height * 4);
+        std::vector<u8> reference(src.size());
+        std::vector<u8> dst(src.size());
+        for(size_t i = 0; i < src.size(); ++i) {
+            src[i] = static_cast<u8>((i * 2654435761U) >> 13);
+        }
+        for(PixelFormat srcFormat: Sources) {
+            for(PixelFormat dstFormat: Destinations) {
+                u32 srcSize = getImageSize(srcFormat, width, height);
+                u32 dstSize = getImageSize(dstFormat, width, height);
+                // Bottom-up source into a top-down destination, as glReadPixels into a YUV or top-down sample
+                Image srcImage = makeImage(src.data(), width, height, getRowSize(srcFormat, width), srcFormat, true);
+                Image referenceImage = makeImage(reference.data(), width, height, getRowSize(dstFormat, width), dstFormat, false);
+                Image dstImage = makeImage(dst.data(), width, height, getRowSize(dstFormat, width), dstFormat, false);
+                Converter converter;
+                selectConverter(converter, dstFormat, srcFormat, Isa::Scalar);
+                convert(converter, referenceImage, srcImage, 0, height);
+
+                for(u32 level = 0; level <= static_cast<u32>(getCpuIsa()); ++level) {
+                    Isa isa = static_cast<Isa>(level);
+                    selectConverter(converter, dstFormat, srcFormat, isa);
+                    memset(dst.data(), 0, dst.size());
+                    convert(converter, dstImage, srcImage, 0, height);
+                    bool verified = 0 == memcmp(dst.data(), reference.data(), dstSize);
+
+                    auto start = std::chrono::steady_clock::now();
+                    for(s32 i = 0; i < iterations; ++i) {
+                        convert(converter, dstImage, srcImage, 0, height);
+                    }
+                    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+                    double seconds = duration.count() / iterations;
+                    double bytes = static_cast<double>(srcSize) + dstSize;
+                    printf("%s,%s,%s,%u,%u,%.3f,%.2f,%s\n",
+                           getFormatName(srcFormat), getFormatName(dstFormat), getIsaName(isa), width, height,
+                           seconds * 1000.0, bytes / seconds / 1.0e9, verified ? "yes" : "no");
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,316 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Throughput, latency and drops of the VCamPipe transport.
+
+A producer thread and a consumer thread talk through two VCamPipe instances mapping the same segment, as the application and the filter do.
+It sweeps the advertised resolutions up to 3840x2160, 3 and 4 bytes per pixel, ring depths, and producer to consumer rate ratios.
+Ratio 0 runs both sides unpaced for the raw throughput, other ratios pace the consumer at --fps and the producer at ratio times that.
+Every row of a frame is stamped with its frame number, and the consumer counts frames whose rows disagree as torn.
+
+Prints CSV, or JSON with --json, one record per configuration.
+Options: --json, --frames N (frames per configuration, default 120), --fps F (consumer rate when paced, default 240), --quick (fewer configurations).
+*/
+#include "VCamPacer.h"
+#include "VCamPipe.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <Windows.h>
+#else
+#    include <time.h>
+#endif
+
+namespace
+{
+using namespace vcam;
+
+struct Size
+{
+    u32 width_;
+    u32 height_;
+};
+
+struct Config
+{
+    u32 width_;
+    u32 height_;
+    u32 bpp_;
+    u32 maxFrames_;
+    double ratio_; //!< Producer rate over consumer rate, 0 for unpaced
+};
+
+struct Result
+{
+    u32 frames_;        //!< Frames published
+    u32 consumed_;      //!< Frames read once
+    u32 dropped_;       //!< Frames published but never read
+    u32 torn_;          //!< Frames whose rows carry different frame numbers
+    double seconds_;    //!< Wall time
+    double cpuSeconds_; //!< CPU time of the process
+    u64 latency_[4];    //!< p50, p90, p99 and max in nanoseconds, from capture to read
+};
+
+double getCpuTime()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return static_cast<double>(k.QuadPart + u.QuadPart) * 1.0e-7;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1.0e-9;
+#endif
+}
+
+void stamp(u8* data, u32 pitch, u32 height, u64 frameNumber)
+{
+    for(u32 y = 0; y < height; ++y) {
+        memcpy(data + static_cast<size_t>(pitch) * y, &frameNumber, sizeof(frameNumber));
+    }
+}
+
+bool isTorn(const u8* data, u32 pitch, u32 height, u64 frameNumber)
+{
+    for(u32 y = 0; y < height; ++y) {
+        u64 value;
+        memcpy(&value, data + static_cast<size_t>(pitch) * y, sizeof(value));
+        if(value != frameNumber) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool run(Result& result, const Config& config, u32 frames, double fps)
+{
+    result = {};
+    u32 frameSize = config.width_ * config.height_ * config.bpp_;
+    VCamPipe reader;
+    VCamPipe writer;
+    if(!reader.openRead(config.width_, config.height_, config.bpp_, config.maxFrames_, frameSize) || !writer.openWrite()) {
+        return false;
+    }
+    std::vector<u8> source(frameSize);
+    std::vector<u8> destination(frameSize);
+    for(size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<u8>((i * 2654435761U) >> 13);
+    }
+    std::vector<u64> latencies;
+    latencies.reserve(frames);
+
+    bool paced = 0.0 < config.ratio_;
+    SystemClock clock;
+    FramePacer consumerPacer(clock);
+    FramePacer producerPacer(clock);
+    if(paced) {
+        consumerPacer.start(static_cast<u64>(1.0e9 / fps));
+        producerPacer.start(static_cast<u64>(1.0e9 / (fps * config.ratio_)));
+    }
+    std::atomic<bool> done(false);
+
+    double cpuStart = getCpuTime();
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        for(u32 i = 0; i < frames;) {
+            VCamPipe::WriteSlot slot;
+            if(!writer.acquireWriteSlot(slot, config.width_, config.height_, config.bpp_)) {
+                // The consumer pins the slot, try again as an application would on its next frame
+                std::this_thread::yield();
+                continue;
+            }
+            memcpy(slot.data_, source.data(), frameSize);
+            stamp(slot.data_, slot.pitch_, config.height_, slot.frameNumber_);
+            writer.commit(slot);
+            ++i;
+            if(paced) {
+                producerPacer.wait();
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    for(;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        if(!reader.waitFrame(paced ? static_cast<u32>(1000.0 / fps) + 1 : 1)) {
+            if(finished) {
+                break;
+            }
+            continue;
+        }
+        VCamPipe::ReadView view;
+        if(VCamPipe::Status::Success == reader.peekRead(view, 0, 0, 0)) {
+            latencies.push_back(getMonotonicTime() - view.timestamp_);
+            u64 frameNumber = view.frameNumber_;
+            memcpy(destination.data(), view.data_, (std::min)(frameSize, view.pitch_ * view.height_));
+            reader.release(view);
+            if(isTorn(destination.data(), config.width_ * config.bpp_, config.height_, frameNumber)) {
+                ++result.torn_;
+            }
+            ++result.consumed_;
+        } else {
+            reader.release(view);
+        }
+        if(paced) {
+            consumerPacer.wait();
+        }
+    }
+    producer.join();
+    result.seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpuSeconds_ = getCpuTime() - cpuStart;
+    result.frames_ = frames;
+    // Frames overwritten in the ring, or still queued when the producer finished
+    result.dropped_ = frames - result.consumed_;
+
+    std::sort(latencies.begin(), latencies.end());
+    const double Percentiles[] = {0.50, 0.90, 0.99, 1.0};
+    for(u32 i = 0; i < 4 && !latencies.empty(); ++i) {
+        size_t index = static_cast<size_t>(Percentiles[i] * static_cast<double>(latencies.size() - 1) + 0.5);
+        result.latency_[i] = latencies[index];
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    bool quick = false;
+    u32 frames = 120;
+    double fps = 240.0;
+    for(s32 i = 1; i < argc; ++i) {
+        if(0 == strcmp(argv[i], "--json")) {
+            json = true;
+        } else if(0 == strcmp(argv[i], "--quick")) {
+            quick = true;
+        } else if(0 == strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = (std::max)(1, atoi(argv[++i]));
+        } else if(0 == strcmp(argv[i], "--fps") && i + 1 < argc) {
+            fps = (std::max)(1.0, atof(argv[++i]));
+        } else {
+            fprintf(stderr, "Usage: %s [--json] [--quick] [--frames N] [--fps F]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The formats the filter advertises, and 4K
+    const Size Sizes[] = {{640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1366, 768}, {1920, 1080}, {3840, 2160}};
+    const Size QuickSizes[] = {{640, 480}, {1920, 1080}, {3840, 2160}};
+    const u32 Bpps[] = {3, 4};
+    const u32 Depths[] = {2, 4, 8};
+    const u32 QuickDepths[] = {4};
+    const double Ratios[] = {0.0, 0.5, 1.0, 2.0};
+
+    std::vector<Config> configs;
+    for(const Size& size: quick ? std::vector<Size>(std::begin(QuickSizes), std::end(QuickSizes)) : std::vector<Size>(std::begin(Sizes), std::end(Sizes))) {
+        for(u32 bpp: Bpps) {
+            for(u32 depth: quick ? std::vector<u32>(std::begin(QuickDepths), std::end(QuickDepths)) : std::vector<u32>(std::begin(Depths), std::end(Depths))) {
+                for(double ratio: Ratios) {
+                    configs.push_back({size.width_, size.height_, bpp, depth, ratio});
+                }
+            }
+        }
+    }
+
+    if(json) {
+        printf("[\n");
+    } else {
+        printf("width,height,bpp,max_frames,ratio,frames,consumed,dropped,drop_rate,torn,seconds,fps,mb_per_s,latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us,cpu_ms_per_frame\n");
+    }
+    bool first = true;
+    for(const Config& config: configs) {
+        Result result;
+        if(!run(result, config, frames, fps)) {
+            fprintf(stderr, "Cannot open a pipe of %ux%ux%u with %u frames\n", config.width_, config.height_, config.bpp_, config.maxFrames_);
+            continue;
+        }
+        double rate = static_cast<double>(result.consumed_) / result.seconds_;
+        double megabytes = rate * config.width_ * config.height_ * config.bpp_ / (1024.0 * 1024.0);
+        double dropRate = static_cast<double>(result.dropped_) / result.frames_;
+        double cpu = result.cpuSeconds_ * 1000.0 / result.frames_;
+        double latency[4];
+        for(u32 i = 0; i < 4; ++i) {
+            latency[i] = static_cast<double>(result.latency_[i]) * 1.0e-3;
+        }
+        if(json) {
+            printf("%s  {\"width\": %u, \"height\": %u, \"bpp\": %u, \"max_frames\": %u, \"ratio\": %.2f, \"frames\": %u, \"consumed\": %u, \"dropped\": %u, \"drop_rate\": %.4f, \"torn\": %u, "
+                   "\"seconds\": %.4f, \"fps\": %.1f, \"mb_per_s\": %.1f, \"latency_p50_us\": %.1f, \"latency_p90_us\": %.1f, \"latency_p99_us\": %.1f, \"latency_max_us\": %.1f, \"cpu_ms_per_frame\": %.3f}",
+                   first ? "" : ",\n", config.width_, config.height_, config.bpp_, config.maxFrames_, config.ratio_, result.frames_, result.consumed_, result.dropped_, dropRate, result.torn_,
+                   result.seconds_, rate, megabytes, latency[0], latency[1], latency[2], latency[3], cpu);
+        } else {
+            printf("%u,%u,%u,%u,%.2f,%u,%u,%u,%.4f,%u,%.4f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n",
+                   config.width_, config.height_, config.bpp_, config.maxFrames_, config.ratio_, result.frames_, result.consumed_, result.dropped_, dropRate, result.torn_,
+                   result.seconds_, rate, megabytes, latency[0], latency[1], latency[2], latency[3], cpu);
+        }
+        first = false;
+        fflush(stdout);
+    }
+    if(json) {
+        printf("\n]\n");
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Speedup of ThreadPool row bands per thread count, for the frame operations of FillBuffer at 3840x2160.
+
+Prints CSV, one line per operation and thread count. Speedup is against the same operation on the calling thread alone.
+Thread counts go up to the number of cores, or to the first argument.
+*/
+#include "VCamScale.h"
+#include "VCamThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using namespace vcam;
+
+const u32 Width = 3840;
+const u32 Height = 2160;
+const s32 Iterations = 20;
+
+double measure(const std::function<void()>& func)
+{
+    func();
+    auto start = std::chrono::steady_clock::now();
+    for(s32 i = 0; i < Iterations; ++i) {
+        func();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return duration.count() * 1000.0 / Iterations;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    u32 maxThreads = (std::max)(1U, std::thread::hardware_concurrency());
+    if(1 < argc && 0 < atoi(argv[1])) {
+        maxThreads = static_cast<u32>(atoi(argv[1]));
+    }
+
+    std::vector<u8> src(static_cast<size_t>(Width) * Height * 4);
+    std::vector<u8> dst(src.size());
+    for(size_t i = 0; i < src.size(); ++i) {
+        src[i] = static_cast<u8>((i * 2654435761U) >> 13);
+    }
+    Image bgr = makeImage(src.data(), Width, Height, Width * 3, PixelFormat::BGR24, true);
+    Image rgbHalf = makeImage(src.data(), Width / 2, Height / 2, Width / 2 * 3, PixelFormat::RGB24, true);
+    Image sample = makeImage(dst.data(), Width, Height, Width * 3, PixelFormat::BGR24, true);
+    Image nv12 = makeImage(dst.data(), Width, Height, Width, PixelFormat::NV12, false);
+    Image bgra = makeImage(dst.data(), Width, Height, Width * 4, PixelFormat::BGRA32, false);
+    Converter toSample;
+    selectConverter(toSample, PixelFormat::BGR24, PixelFormat::RGB24, getCpuIsa());
+    Converter toNv12;
+    selectConverter(toNv12, PixelFormat::NV12, PixelFormat::BGR24, getCpuIsa());
+    Scaler scaler;
+    scaler.reset(Width, Height, Width / 2, Height / 2, PixelFormat::RGB24, ScaleFilter::Auto, getCpuIsa());
+
+    printf("operation,threads,ms_per_frame,speedup\n");
+    const char* Names[] = {"copy", "RGB24_to_BGR24", "BGR24_to_NV12", "scale_1920x1080_to_3840x2160"};
+    for(u32 operation = 0; operation < 4; ++operation) {
+        double single = 0.0;
+        for(u32 threads = 1; threads <= maxThreads; ++threads) {
+            std::unique_ptr<ThreadPool> pool(new ThreadPool(threads - 1));
+            std::function<void()> func;
+            switch(operation) {
+            case 0:
+                func = [&]() {
+                    auto band = [&](u32 rowBegin, u32 rowEnd) {
+                        size_t pitch = Width * 3;
+                        memcpy(dst.data() + pitch * rowBegin, src.data() + pitch * rowBegin, pitch * (rowEnd - rowBegin));
+                    };
+                    pool->parallelRows(Height, Width * 6, 1, band);
+                };
+                break;
+            case 1:
+                func = [&]() {
+                    Image rgb = bgr;
+                    rgb.format_ = PixelFormat::RGB24;
+                    auto band = [&](u32 rowBegin, u32 rowEnd) { convert(toSample, sample, rgb, rowBegin, rowEnd); };
+                    pool->parallelRows(Height, Width * 6, 1, band);
+                };
+                break;
+            case 2:
+                func = [&]() {
+                    auto band = [&](u32 rowBegin, u32 rowEnd) { convert(toNv12, nv12, bgr, rowBegin, rowEnd); };
+                    pool->parallelRows(Height, Width * 5, getRowAlignment(PixelFormat::NV12), band);
+                };
+                break;
+            default:
+                func = [&]() {
+                    auto band = [&](u32 rowBegin, u32 rowEnd) { scaler.scale(bgra, rgbHalf, rowBegin, rowEnd); };
+                    pool->parallelRows(Height, Width * 4 + Width / 2 * 3, 16, band);
+                };
+                break;
+            }
+            double ms = measure(func);
+            if(1 == threads) {
+                single = ms;
+            }
+            printf("%s,%u,%.3f,%.2f\n", Names[operation], threads, ms, single / ms);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Throughput of Scaler for the resolutions a producer and the filter commonly disagree on.
+
+Prints CSV, one line per case and instruction set, single threaded and split into row bands over a ThreadPool.
+Each instruction set is checked against the scalar kernels before it is timed.
+*/
+#include "VCamScale.h"
+#include "VCamThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using namespace vcam;
+
+struct Case
+{
+    u32 srcWidth_;
+    u32 srcHeight_;
+    u32 dstWidth_;
+    u32 dstHeight_;
+};
+
+const u32 BandRows = 32;
+
+void scaleFrame(ThreadPool* pool, const Scaler& scaler, const Image& dst, const Image& src)
+{
+    u32 bands = (dst.height_ + BandRows - 1) / BandRows;
+    auto band = [&](u32 index) {
+        u32 begin = index * BandRows;
+        scaler.scale(dst, src, begin, (std::min)(begin + BandRows, dst.height_));
+    };
+    if(nullptr == pool) {
+        for(u32 i = 0; i < bands; ++i) {
+            band(i);
+        }
+    } else {
+        pool->parallelFor(bands, band);
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    s32 iterations = 1 < argc ? atoi(argv[1]) : 20;
+    if(iterations <= 0) {
+        iterations = 1;
+    }
+    const Case Cases[] = {
+        {1280, 720, 1920, 1080},
+        {1920, 1080, 1280, 720},
+        {3840, 2160, 1920, 1080},
+        {1920, 1080, 3840, 2160},
+        {1920, 1080, 640, 480},
+        {1366, 768, 1024, 768},
+    };
+    u32 concurrency = (std::max)(1U, std::thread::hardware_concurrency());
+    ThreadPool pool(concurrency - 1);
+
+    printf("src,dst,isa,threads,ms_per_frame,verified\n");
+    for(const Case& c: Cases) {
+        std::vector<u8> src(static_cast<size_t>(c.srcWidth_) * c.srcHeight_ * 3);
+        std::vector<u8> reference(static_cast<size_t>(c.dstWidth_) * c.dstHeight_ * 4);
+        std::vector<u8> dst(reference.size());
+        for(size_t i = 0; i < src.size(); ++i) {
+            src[i] = static_cast<u8>((i * 2654435761U) >> 13);
+        }
+        // Bottom-up BGR24, what push(width, height, 3, data) sends
+        Image srcImage = makeImage(src.data(), c.srcWidth_, c.srcHeight_, c.srcWidth_ * 3, PixelFormat::BGR24, true);
+        Image referenceImage = makeImage(reference.data(), c.dstWidth_, c.dstHeight_, c.dstWidth_ * 4, PixelFormat::BGRA32, false);
+        Image dstImage = makeImage(dst.data(), c.dstWidth_, c.dstHeight_, c.dstWidth_ * 4, PixelFormat::BGRA32, false);
+        Scaler scaler;
+        scaler.reset(c.dstWidth_, c.dstHeight_, c.srcWidth_, c.srcHeight_, PixelFormat::BGR24, ScaleFilter::Auto, Isa::Scalar);
+        scaleFrame(nullptr, scaler, referenceImage, srcImage);
+
+        for(u32 level = 0; level <= static_cast<u32>(getCpuIsa()); ++level) {
+            Isa isa = static_cast<Isa>(level);
+            scaler.reset(c.dstWidth_, c.dstHeight_, c.srcWidth_, c.srcHeight_, PixelFormat::BGR24, ScaleFilter::Auto, isa);
+            for(ThreadPool* p: {static_cast<ThreadPool*>(nullptr), &pool}) {
+                memset(dst.data(), 0, dst.size());
+                scaleFrame(p, scaler, dstImage, srcImage);
+                bool verified = 0 == memcmp(dst.data(), reference.data(), dst.size());
+
+                auto start = std::chrono::steady_clock::now();
+                for(s32 i = 0; i < iterations; ++i) {
+                    scaleFrame(p, scaler, dstImage, srcImage);
+                }
+                std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+                printf("%ux%u,%ux%u,%s,%u,%.3f,%s\n",
+                       c.srcWidth_, c.srcHeight_, c.dstWidth_, c.dstHeight_, getIsaName(isa),
+                       nullptr == p ? 1 : concurrency, duration.count() * 1000.0 / iterations, verified ? "yes" : "no");
+            }
+        }
+    }
+    return 0;
+}
@@ -70,10 +70,23 @@ For more information, please refer to <http://unlicense.org>
 
 // {0C55EFF1-B421-48A8-B537-6194617AC29D}
 DEFINE_GUID(CLSID_VCAM_VirtualCam, 0xc55eff1, 0xb421, 0x48a8, 0xb5, 0x37, 0x61, 0x94, 0x61, 0x7a, 0xc2, 0x9d);
-
-const AMOVIESETUP_MEDIATYPE AMSMediaTypesCam = {
-    &MEDIATYPE_Video,  // Major
-    &MEDIASUBTYPE_RGB24 // Minor
+// Cameras of channels 1 to 3
+// {0C55EFF2-B421-48A8-B537-6194617AC29D}
+DEFINE_GUID(CLSID_VCAM_VirtualCam2, 0xc55eff2, 0xb421, 0x48a8, 0xb5, 0x37, 0x61, 0x94, 0x61, 0x7a, 0xc2, 0x9d);
+// {0C55EFF3-B421-48A8-B537-6194617AC29D}
+DEFINE_GUID(CLSID_VCAM_VirtualCam3, 0xc55eff3, 0xb421, 0x48a8, 0xb5, 0x37, 0x61, 0x94, 0x61, 0x7a, 0xc2, 0x9d);
+// {0C55EFF4-B421-48A8-B537-6194617AC29D}
+DEFINE_GUID(CLSID_VCAM_VirtualCam4, 0xc55eff4, 0xb421, 0x48a8, 0xb5, 0x37, 0x61, 0x94, 0x61, 0x7a, 0xc2, 0x9d);
+
+// I420 is not in every SDK's uuids.h, this is its FOURCC subtype
+// {30323449-0000-0010-8000-00AA00389B71}
+DEFINE_GUID(MEDIASUBTYPE_VCAM_I420, 0x30323449, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+
+const AMOVIESETUP_MEDIATYPE AMSMediaTypesCam[] = {
+    {&MEDIATYPE_Video, &MEDIASUBTYPE_NV12},
+    {&MEDIATYPE_Video, &MEDIASUBTYPE_YUY2},
+    {&MEDIATYPE_Video, &MEDIASUBTYPE_VCAM_I420},
+    {&MEDIATYPE_Video, &MEDIASUBTYPE_RGB24},
 };
 
 const AMOVIESETUP_PIN AMSPinCam = {
@@ -84,16 +97,15 @@ const AMOVIESETUP_PIN AMSPinCam = {
     FALSE,
     &CLSID_NULL,
     nullptr,
-    1,
-    &AMSMediaTypesCam
+    sizeof(AMSMediaTypesCam) / sizeof(AMSMediaTypesCam[0]),
+    AMSMediaTypesCam
 };
 
-const AMOVIESETUP_FILTER AMSFilterCam = {
-    &CLSID_VCAM_VirtualCam,
-    L"VCam Virtual Cam",
-    MERIT_DO_NOT_USE,
-    1,
-    &AMSPinCam
+const AMOVIESETUP_FILTER AMSFilterCam[] = {
+    {&CLSID_VCAM_VirtualCam, L"VCam Virtual Cam", MERIT_DO_NOT_USE, 1, &AMSPinCam},
+    {&CLSID_VCAM_VirtualCam2, L"VCam Virtual Cam 2", MERIT_DO_NOT_USE, 1, &AMSPinCam},
+    {&CLSID_VCAM_VirtualCam3, L"VCam Virtual Cam 3", MERIT_DO_NOT_USE, 1, &AMSPinCam},
+    {&CLSID_VCAM_VirtualCam4, L"VCam Virtual Cam 4", MERIT_DO_NOT_USE, 1, &AMSPinCam},
 };
 
 REGFILTER2 RegFilter2 =
@@ -104,15 +116,32 @@ REGFILTER2 RegFilter2 =
 	&AMSPinCam
 };
 
+// One camera per pipe channel, channel N is read by the filter of template N
 CFactoryTemplate g_Templates[] = {
-    {L"VCam Virtual Cam",
-     &CLSID_VCAM_VirtualCam,
-     CVirtualCamera::CreateInstance,
+    {AMSFilterCam[0].strName,
+     AMSFilterCam[0].clsID,
+     CVirtualCamera::CreateInstance<0>,
+     nullptr,
+     &AMSFilterCam[0]},
+    {AMSFilterCam[1].strName,
+     AMSFilterCam[1].clsID,
+     CVirtualCamera::CreateInstance<1>,
+     nullptr,
+     &AMSFilterCam[1]},
+    {AMSFilterCam[2].strName,
+     AMSFilterCam[2].clsID,
+     CVirtualCamera::CreateInstance<2>,
+     nullptr,
+     &AMSFilterCam[2]},
+    {AMSFilterCam[3].strName,
+     AMSFilterCam[3].clsID,
+     CVirtualCamera::CreateInstance<3>,
      nullptr,
-     &AMSFilterCam},
+     &AMSFilterCam[3]},
 };
 
 int g_cTemplates = sizeof(g_Templates) / sizeof(g_Templates[0]);
+static_assert(sizeof(g_Templates) / sizeof(g_Templates[0]) == vcam::VCamPipe::MaxChannels, "A camera per channel");
 
 STDAPI RegisterFilters(BOOL bRegister)
 {
@@ -125,19 +154,22 @@ STDAPI RegisterFilters(BOOL bRegister)
     if (FAILED(hr)) {
         return hr;
     }
-    if (bRegister) {
-        hr = filterMapper2->RegisterFilter(
-            CLSID_VCAM_VirtualCam,
-            NAME("VCam Virtual Cam"),
-            NULL,
-            &CLSID_VideoInputDeviceCategory,
-            NAME("VCam Virtual Cam"),
-            &RegFilter2);
-        if (E_POINTER == hr) {
-            hr = S_OK;
+    for (int i = 0; i < g_cTemplates && SUCCEEDED(hr); ++i) {
+        const CFactoryTemplate& factory = g_Templates[i];
+        if (bRegister) {
+            hr = filterMapper2->RegisterFilter(
+                *factory.m_ClsID,
+                factory.m_Name,
+                NULL,
+                &CLSID_VideoInputDeviceCategory,
+                factory.m_Name,
+                &RegFilter2);
+            if (E_POINTER == hr) {
+                hr = S_OK;
+            }
+        } else {
+            hr = filterMapper2->UnregisterFilter(&CLSID_VideoInputDeviceCategory, factory.m_Name, *factory.m_ClsID);
         }
-    } else {
-        hr = filterMapper2->UnregisterFilter(&CLSID_VideoInputDeviceCategory, NAME("VCam Virtual Cam"), CLSID_VCAM_VirtualCam);
     }
     filterMapper2->Release();
     return hr;
@@ -0,0 +1,100 @@
+﻿#pragma once
+#ifndef INC_VCAM_TESTS_CHECK_H_
+#    define INC_VCAM_TESTS_CHECK_H_
+// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Checks shared by the tests, a failed one is printed and counted and fails the test.
+*/
+#    include "VCamPlatform.h"
+#    include <cstdio>
+
+namespace vcam
+{
+namespace test
+{
+/**
+ * @return Number of failed checks so far
+ */
+inline u32& getNumFailures()
+{
+    static u32 numFailures = 0;
+    return numFailures;
+}
+
+/**
+ * @brief Print and count a failed check
+ * @param condition [in] ... Whether the check passed
+ * @param what [in] ... What the check expects
+ */
+inline void check(bool condition, const char* what)
+{
+    if(!condition) {
+        printf("failed: %s\n", what);
+        ++getNumFailures();
+    }
+}
+
+/**
+ * @brief Print the result of the test
+ * @return Exit code of main, 0 if every check passed
+ */
+inline int finish()
+{
+    printf("%s\n", 0 == getNumFailures() ? "passed" : "FAILED");
+    return 0 == getNumFailures() ? 0 : 1;
+}
+} // namespace test
+} // namespace vcam
+#endif // INC_VCAM_TESTS_CHECK_H_
@@ -0,0 +1,189 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Simulation of JitterBuffer against a synthetic jittery producer.
+
+A producer at 30 frames per second delivers most frames up to a millisecond off schedule,
+but stalls for 8% of them by 42 milliseconds and for 2% by 105 milliseconds in a fixed pattern, then delivers its backlog a millisecond apart.
+A consumer reading at the same rate keeps the target depth of frames queued, a frame later than that depth covers comes too late.
+For each drop target, the test checks the target depth the buffer settles on and the rate of frames which came too late.
+*/
+#include "Check.h"
+#include "VCamJitter.h"
+#include <cstdio>
+
+namespace
+{
+using namespace vcam;
+using test::check;
+
+constexpr u64 Period = 33333333;     //!< Nanoseconds between producer frames
+constexpr u64 ReadInterval = Period;     //!< Nanoseconds between reads
+constexpr u64 Millisecond = 1000000;
+constexpr u64 Origin = 1000 * Millisecond;
+constexpr u32 MaxDepth = 8;
+constexpr u32 NumFrames = 10001;     //!< The last window of frames begins and ends on time
+constexpr u32 WarmUp = JitterBuffer::WindowSize;
+
+/**
+@return Nanoseconds the producer stalls before the frame
+*/
+u64 getStall(u32 frame)
+{
+    switch(frame % 50) {
+    case 10:
+    case 20:
+    case 30:
+    case 40:
+        return 42 * Millisecond;
+    case 25:
+        return 105 * Millisecond;
+    default:
+        return (frame * 7919ULL) % 1000 * 1000;
+    }
+}
+
+/**
+@brief Producer which delivers each frame after its schedule, its stall and the frame before
+*/
+class Producer
+{
+public:
+    u64 next(u32 frame)
+    {
+        u64 scheduled = Origin + frame * Period;
+        u64 time = scheduled + getStall(frame);
+        time_ = 0 < frame && time < time_ + Millisecond ? time_ + Millisecond : time;
+        lateness_ = time_ - scheduled;
+        return time_;
+    }
+
+    /**
+    @return Nanoseconds the last frame came behind its schedule
+    */
+    u64 getLateness() const
+    {
+        return lateness_;
+    }
+
+private:
+    u64 time_ = 0;
+    u64 lateness_ = 0;
+};
+
+/**
+@brief Feed the producer's frames and check the depth and drop rate for a drop target
+@param expectedDepth [in] ... Frames which cover the lateness at the percentile of the drop target
+*/
+void simulate(double dropTarget, u32 expectedDepth, u64 minDelay, u64 maxDelay)
+{
+    JitterBuffer jitter;
+    jitter.setDropTarget(dropTarget);
+    jitter.setReadInterval(ReadInterval);
+    jitter.setMaxDepth(MaxDepth);
+
+    // Frames later than the queue in front of them covers miss their read, the buffer sees them all the same
+    Producer producer;
+    u32 numLate = 0;
+    for(u32 i = 0; i < NumFrames; ++i) {
+        u64 timestamp = producer.next(i);
+        if(WarmUp <= i && static_cast<u64>(jitter.getTargetDepth()) * ReadInterval < producer.getLateness()) {
+            ++numLate;
+        }
+        jitter.addFrame(i, timestamp);
+    }
+    double dropRate = static_cast<double>(numLate) / (NumFrames - WarmUp);
+    printf("drop target %.3f depth %u delay %llu ns drop rate %.4f\n", dropTarget, jitter.getTargetDepth(), static_cast<unsigned long long>(jitter.getDelay()), dropRate);
+
+    check(Period - Millisecond / 100 < jitter.getPeriod() && jitter.getPeriod() < Period + Millisecond / 100, "the period is the producer's");
+    check(minDelay <= jitter.getDelay() && jitter.getDelay() <= maxDelay, "the delay is the lateness at the percentile");
+    check(expectedDepth == jitter.getTargetDepth(), "the depth covers the delay");
+    check(dropRate <= dropTarget, "no more frames than the drop target come too late");
+}
+
+void testSteady()
+{
+    JitterBuffer jitter;
+    jitter.setReadInterval(ReadInterval);
+    jitter.setMaxDepth(MaxDepth);
+    for(u32 i = 0; i < NumFrames; ++i) {
+        jitter.addFrame(i, Origin + i * Period);
+    }
+    check(0 == jitter.getTargetDepth(), "a steady producer needs no queue");
+}
+
+void testMaxDepth()
+{
+    JitterBuffer jitter;
+    jitter.setDropTarget(0.0);
+    jitter.setReadInterval(ReadInterval);
+    jitter.setMaxDepth(2);
+    Producer producer;
+    for(u32 i = 0; i < NumFrames; ++i) {
+        jitter.addFrame(i, producer.next(i));
+    }
+    check(2 == jitter.getTargetDepth(), "the depth stays within the ring");
+}
+} // namespace
+
+int main(void)
+{
+    // 5% lets the stalls of 105 milliseconds and the frame after each go, 42 milliseconds is 2 reads
+    simulate(0.05, 2, 41 * Millisecond, 44 * Millisecond);
+    // 1% covers every frame, 105 milliseconds is 4 reads
+    simulate(0.01, 4, 104 * Millisecond, 107 * Millisecond);
+    testSteady();
+    testMaxDepth();
+    return test::finish();
+}
@@ -0,0 +1,156 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Test of FramePacer on a VirtualClock.
+
+The clock only moves by VirtualClock::advance and the sleeps of FramePacer::wait, so every deadline is checked exactly:
+deadlines fall on the grid of the start time, work and oversleeping between waits never drift it,
+and a caller late by whole intervals takes the last deadline passed and skips the others, which getMissed counts.
+*/
+#include "Check.h"
+#include "VCamPacer.h"
+
+namespace
+{
+using namespace vcam;
+using test::check;
+
+constexpr u64 Origin = 1000000;
+constexpr u64 Interval = 33333333; //!< 30 frames per second, not a whole number of microseconds
+
+void testDeadlines()
+{
+    VirtualClock clock(Origin);
+    FramePacer pacer(clock);
+    check(!pacer.isStarted(), "not started before start");
+    pacer.start(Interval);
+    check(pacer.isStarted() && Interval == pacer.getInterval() && Origin == pacer.getOrigin(), "start takes the interval and now");
+    bool onGrid = true;
+    for(u64 i = 0; i < 10; ++i) {
+        u64 deadline = pacer.wait();
+        onGrid = onGrid && Origin + i * Interval == deadline && deadline == clock.now() && deadline == pacer.getDeadline();
+    }
+    check(onGrid, "wait sleeps until each deadline of the grid");
+    check(0 == pacer.getMissed(), "no deadline missed without work");
+}
+
+void testNoDrift()
+{
+    VirtualClock clock(Origin);
+    FramePacer pacer(clock);
+    pacer.start(Interval);
+    constexpr u64 NumFrames = 100000;
+    u64 deadline = 0;
+    for(u64 i = 0; i < NumFrames; ++i) {
+        deadline = pacer.wait();
+        // Oversleeping and work of varying length, together always within the interval
+        clock.advance(Interval / 2 + (i * 7919) % (Interval / 3));
+    }
+    check(Origin + (NumFrames - 1) * Interval == deadline, "late wake ups and work do not drift deadlines");
+    check(0 == pacer.getMissed(), "no deadline missed by work within the interval");
+}
+
+void testMissed()
+{
+    VirtualClock clock(Origin);
+    FramePacer pacer(clock);
+    pacer.start(Interval);
+    u64 deadline = pacer.wait();
+    check(Origin == deadline, "the first deadline is the start time");
+
+    // Deadlines 1 and 2 pass while working, the late caller takes 2 at once and skips 1
+    clock.advance(Interval * 5 / 2);
+    deadline = pacer.wait();
+    check(Origin + 2 * Interval == deadline && Origin + Interval * 5 / 2 == clock.now(), "a late caller takes the last deadline passed without sleeping");
+    check(1 == pacer.getMissed(), "the deadline passed by a whole interval is missed");
+
+    // Deadlines 3, 4 and 5 pass, 3 and 4 are missed
+    clock.advance(Interval * 3);
+    deadline = pacer.wait();
+    check(Origin + 5 * Interval == deadline, "a caller late by several intervals takes only the last deadline passed");
+    check(3 == pacer.getMissed(), "missed deadlines add up");
+
+    // Back on the grid after missing
+    deadline = pacer.wait();
+    check(Origin + 6 * Interval == deadline && deadline == clock.now(), "deadlines after missing stay on the grid");
+    check(3 == pacer.getMissed(), "a caller on time misses nothing");
+}
+
+void testRestart()
+{
+    VirtualClock clock(Origin);
+    FramePacer pacer(clock);
+    pacer.start(Interval);
+    pacer.wait();
+    clock.advance(Interval * 10);
+    pacer.stop();
+    check(!pacer.isStarted(), "stop forgets deadlines");
+
+    // wait starts again from now with the same interval, not counting the stopped time as missed
+    u64 now = clock.now();
+    u64 deadline = pacer.wait();
+    check(pacer.isStarted() && now == pacer.getOrigin() && now == deadline, "wait after stop starts from now");
+    check(Interval == pacer.getInterval() && 0 == pacer.getMissed(), "a restart keeps the interval and forgets misses");
+    check(now + Interval == pacer.wait(), "a restart counts deadlines from the new origin");
+}
+} // namespace
+
+int main(void)
+{
+    testDeadlines();
+    testNoDrift();
+    testMissed();
+    testRestart();
+    return test::finish();
+}
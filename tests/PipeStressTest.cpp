@@ -0,0 +1,203 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Stress test of VCamPipe against torn frames.
+
+A writer thread publishes 3840x2160 frames as fast as it can, alternating push and acquireWriteSlot, while readers of each read policy
+pin every frame they get and check every byte of it against its frame number. Any torn frame fails the test.
+Options: [frames] (frames to publish, default 240).
+*/
+#include "Check.h"
+#include "VCamPipe.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using namespace vcam;
+
+constexpr u32 Width = 3840;
+constexpr u32 Height = 2160;
+constexpr u32 Bpp = 4;
+constexpr u32 MaxFrames = 4;
+constexpr u32 Channel = VCamPipe::MaxChannels - 1; //!< Off the channel of a running camera
+constexpr u64 NumWords = static_cast<u64>(Width) * Height * Bpp / sizeof(u64);
+
+u64 getWord(u64 frameNumber, u64 index)
+{
+    return frameNumber * 0x9E3779B97F4A7C15ULL + index;
+}
+
+void fill(u8* data, u64 frameNumber)
+{
+    u64* words = reinterpret_cast<u64*>(data);
+    for(u64 i = 0; i < NumWords; ++i) {
+        words[i] = getWord(frameNumber, i);
+    }
+}
+
+bool isIntact(const VCamPipe::ReadView& view)
+{
+    if(Width != view.width_ || Height != view.height_ || Bpp != view.bpp_) {
+        return false;
+    }
+    const u64* words = reinterpret_cast<const u64*>(view.data_);
+    for(u64 i = 0; i < NumWords; ++i) {
+        if(getWord(view.frameNumber_, i) != words[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Reader
+{
+    VCamPipe pipe_;
+    u32 verified_ = 0; //!< Frames checked byte by byte
+    u32 torn_ = 0;     //!< Frames of which a byte disagrees with the frame number
+};
+
+void read(Reader& reader, const std::atomic<bool>& done)
+{
+    for(;;) {
+        // Published frames are drained after the writer has finished
+        bool isDone = done.load(std::memory_order_acquire);
+        reader.pipe_.waitFrame(10);
+        VCamPipe::ReadView view;
+        VCamPipe::Status status = reader.pipe_.peekRead(view, 0, 0, 0x7FFFFFFFFFFFFFFFLL);
+        if(VCamPipe::Status::Success == status) {
+            if(isIntact(view)) {
+                ++reader.verified_;
+            } else {
+                ++reader.torn_;
+            }
+        }
+        reader.pipe_.release(view);
+        if(isDone && VCamPipe::Status::Success != status) {
+            return;
+        }
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    u32 numFrames = 240;
+    if(1 < argc && 0 < atoi(argv[1])) {
+        numFrames = static_cast<u32>(atoi(argv[1]));
+    }
+
+    const VCamPipe::ReadPolicy Policies[] = {VCamPipe::ReadPolicy::Queue, VCamPipe::ReadPolicy::Latest};
+    constexpr u32 NumReaders = sizeof(Policies) / sizeof(Policies[0]);
+    Reader readers[NumReaders];
+    VCamPipe writer;
+    for(u32 i = 0; i < NumReaders; ++i) {
+        if(!readers[i].pipe_.openRead(Width, Height, Bpp, MaxFrames, Width * Height * Bpp, Channel)) {
+            fprintf(stderr, "Failed to open reader %u\n", i);
+            return 1;
+        }
+        readers[i].pipe_.setReadPolicy(Policies[i]);
+    }
+    if(!writer.openWrite(Channel)) {
+        fprintf(stderr, "Failed to open writer\n");
+        return 1;
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for(Reader& reader: readers) {
+        threads.emplace_back(read, std::ref(reader), std::cref(done));
+    }
+    // Frame numbers count commits, a push which fails on a pinned slot takes none
+    std::vector<u8> frame(static_cast<size_t>(Width) * Height * Bpp);
+    u64 frameNumber = 0;
+    u32 filled = ~0U;
+    while(frameNumber < numFrames) {
+        if(0 == (frameNumber & 1)) {
+            if(filled != frameNumber) {
+                fill(frame.data(), frameNumber);
+                filled = static_cast<u32>(frameNumber);
+            }
+            if(writer.push(Width, Height, PixelFormat::BGRA32, VCamPipe::FrameFlag_None, frame.data())) {
+                ++frameNumber;
+            }
+        } else {
+            VCamPipe::WriteSlot slot;
+            if(writer.acquireWriteSlot(slot, Width, Height, PixelFormat::BGRA32, VCamPipe::FrameFlag_None)) {
+                fill(slot.data_, slot.frameNumber_);
+                frameNumber = slot.frameNumber_ + 1;
+                writer.commit(slot);
+            }
+        }
+    }
+    done.store(true, std::memory_order_release);
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+
+    for(u32 i = 0; i < NumReaders; ++i) {
+        const Reader& reader = readers[i];
+        printf("reader %u verified %u torn %u\n", i, reader.verified_, reader.torn_);
+        test::check(0 < reader.verified_, "every reader gets frames");
+        test::check(0 == reader.torn_, "no frame is torn");
+    }
+    writer.close();
+    for(Reader& reader: readers) {
+        reader.pipe_.close();
+    }
+    return test::finish();
+}
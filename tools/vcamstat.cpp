@@ -0,0 +1,279 @@
+﻿// clang-format off
+/*
+# License
+This software is distributed under two licenses, choose whichever you like.
+
+## MIT License
+Copyright (c) 2021 Takuro Sakai
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+## Public Domain
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+// clang-format on
+/**
+@brief Live statistics of the VCamPipe in shared memory.
+
+The pipe is mapped read-only with openMonitor, which takes no cursor, so it never disturbs the producer or the filter.
+A channel given by name is looked up with findChannel, which briefly locks the channel directory and creates it if missing.
+Every interval it prints frame rates, drop rates and latency percentiles of the interval, and the registered readers.
+Usage: vcamstat [interval milliseconds, default 1000] [number of intervals, default forever] [channel index or name, default 0]
+*/
+#include "VCamPipe.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace
+{
+using namespace vcam;
+
+struct HistogramSnapshot
+{
+    u32 bins_[StatHistogram::NumBins];
+};
+
+/**
+ * @brief Copy of the counters in PipeStats
+ */
+struct Snapshot
+{
+    u32 pushed_;
+    u32 overflows_;
+    u32 writeBusy_;
+    u32 staleReaders_;
+    u32 tilesCopied_;
+    u32 tilesSkipped_;
+    u32 duplicates_;
+    u32 rejected_;
+    u32 blocked_;
+    u32 popped_;
+    u32 repeats_;
+    u32 syncTimeouts_;
+    u32 empty_;
+    u32 skipped_;
+    u32 delivered_;
+    u32 dropped_;
+    u32 lateSamples_;
+    u32 samplesReused_;
+    u32 samplesPatched_;
+    u32 rowsSkipped_;
+    HistogramSnapshot writeTime_;
+    HistogramSnapshot blockTime_;
+    HistogramSnapshot waitTime_;
+    HistogramSnapshot latency_;
+    HistogramSnapshot readTime_;
+    HistogramSnapshot fillTime_;
+};
+
+void load(Snapshot& snapshot, const VCamPipe& pipe)
+{
+    const PipeStats& stats = *pipe.getStats();
+    snapshot.pushed_ = stats.pushed_.load(std::memory_order_relaxed);
+    snapshot.overflows_ = stats.overflows_.load(std::memory_order_relaxed);
+    snapshot.writeBusy_ = stats.writeBusy_.load(std::memory_order_relaxed);
+    snapshot.staleReaders_ = stats.staleReaders_.load(std::memory_order_relaxed);
+    snapshot.tilesCopied_ = stats.tilesCopied_.load(std::memory_order_relaxed);
+    snapshot.tilesSkipped_ = stats.tilesSkipped_.load(std::memory_order_relaxed);
+    snapshot.duplicates_ = stats.duplicates_.load(std::memory_order_relaxed);
+    snapshot.rejected_ = stats.rejected_.load(std::memory_order_relaxed);
+    snapshot.blocked_ = stats.blocked_.load(std::memory_order_relaxed);
+    snapshot.popped_ = stats.popped_.load(std::memory_order_relaxed);
+    snapshot.repeats_ = stats.repeats_.load(std::memory_order_relaxed);
+    snapshot.syncTimeouts_ = stats.syncTimeouts_.load(std::memory_order_relaxed);
+    snapshot.empty_ = stats.empty_.load(std::memory_order_relaxed);
+    snapshot.skipped_ = pipe.getSkippedFrames();
+    snapshot.delivered_ = stats.delivered_.load(std::memory_order_relaxed);
+    snapshot.dropped_ = stats.dropped_.load(std::memory_order_relaxed);
+    snapshot.lateSamples_ = stats.lateSamples_.load(std::memory_order_relaxed);
+    snapshot.samplesReused_ = stats.samplesReused_.load(std::memory_order_relaxed);
+    snapshot.samplesPatched_ = stats.samplesPatched_.load(std::memory_order_relaxed);
+    snapshot.rowsSkipped_ = stats.rowsSkipped_.load(std::memory_order_relaxed);
+    stats.writeTime_.load(snapshot.writeTime_.bins_);
+    stats.blockTime_.load(snapshot.blockTime_.bins_);
+    stats.waitTime_.load(snapshot.waitTime_.bins_);
+    stats.latency_.load(snapshot.latency_.bins_);
+    stats.readTime_.load(snapshot.readTime_.bins_);
+    stats.fillTime_.load(snapshot.fillTime_.bins_);
+}
+
+const char* getOverflowName(VCamPipe::OverflowPolicy policy)
+{
+    switch(policy) {
+    case VCamPipe::OverflowPolicy::DropOldest:
+        return "drop oldest";
+    case VCamPipe::OverflowPolicy::DropNewest:
+        return "drop newest";
+    case VCamPipe::OverflowPolicy::Block:
+        return "block";
+    }
+    return "unknown";
+}
+
+const char* getReadName(VCamPipe::ReadPolicy policy)
+{
+    switch(policy) {
+    case VCamPipe::ReadPolicy::Queue:
+        return "queue";
+    case VCamPipe::ReadPolicy::Latest:
+        return "latest";
+    case VCamPipe::ReadPolicy::Buffered:
+        return "buffered";
+    }
+    return "unknown";
+}
+
+double rate(u32 current, u32 previous, double seconds)
+{
+    // Counters wrap around, the difference of unsigned values is still right
+    return static_cast<double>(current - previous) / seconds;
+}
+
+void printHistogram(const char* name, const HistogramSnapshot& current, const HistogramSnapshot& previous)
+{
+    HistogramSnapshot interval;
+    u64 count = 0;
+    for(u32 i = 0; i < StatHistogram::NumBins; ++i) {
+        interval.bins_[i] = current.bins_[i] - previous.bins_[i];
+        count += interval.bins_[i];
+    }
+    printf("  %-8s n %6llu", name, static_cast<unsigned long long>(count));
+    const double Percentiles[] = {50.0, 90.0, 99.0, 100.0};
+    const char* Labels[] = {"p50", "p90", "p99", "max"};
+    for(u32 i = 0; i < 4; ++i) {
+        double us = static_cast<double>(StatHistogram::getPercentile(interval.bins_, Percentiles[i])) * 1.0e-3;
+        printf("  %s %10.1fus", Labels[i], us);
+    }
+    printf("\n");
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    u32 interval = 1000;
+    s32 count = -1;
+    if(1 < argc && 0 < atoi(argv[1])) {
+        interval = static_cast<u32>(atoi(argv[1]));
+    }
+    if(2 < argc) {
+        count = atoi(argv[2]);
+    }
+    // A channel by index, or by its name in the channel directory
+    u32 channel = 0;
+    if(3 < argc) {
+        char* end = nullptr;
+        channel = static_cast<u32>(strtoul(argv[3], &end, 10));
+        if('\0' != *end) {
+            channel = VCamPipe::findChannel(argv[3], false);
+        }
+        if(VCamPipe::MaxChannels <= channel) {
+            fprintf(stderr, "No channel %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    VCamPipe pipe;
+    if(!pipe.openMonitor(channel)) {
+        fprintf(stderr, "No VCamPipe on channel %u, start the camera first\n", channel);
+        return 1;
+    }
+
+    static Snapshot snapshots[2];
+    load(snapshots[0], pipe);
+    auto previousTime = std::chrono::steady_clock::now();
+    for(s32 i = 0; count < 0 || i < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        const Snapshot& previous = snapshots[i & 1];
+        Snapshot& current = snapshots[(i + 1) & 1];
+        load(current, pipe);
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - previousTime).count();
+        previousTime = now;
+
+        u32 width = 0;
+        u32 height = 0;
+        u32 bpp = 0;
+        pipe.getFormat(width, height, bpp);
+        VCamPipe::ReaderInfo readers[VCamPipe::MaxReaders];
+        u32 numReaders = pipe.getReaders(readers, VCamPipe::MaxReaders);
+        printf("%ux%ux%u  %u readers  ring %u  %s  fps pushed %.1f read %.1f delivered %.1f\n", width, height, bpp, numReaders, pipe.getMaxFrames(),
+               getOverflowName(pipe.getOverflowPolicy()),
+               rate(current.pushed_, previous.pushed_, seconds),
+               rate(current.popped_, previous.popped_, seconds),
+               rate(current.delivered_, previous.delivered_, seconds));
+        printf("  drops/s overflow %.1f rejected %.1f skipped %.1f gap %.1f  repeats/s %.1f  sync timeouts/s %.1f  empty/s %.1f  busy/s %.1f  blocked/s %.1f  stale readers/s %.1f\n",
+               rate(current.overflows_, previous.overflows_, seconds),
+               rate(current.rejected_, previous.rejected_, seconds),
+               rate(current.skipped_, previous.skipped_, seconds),
+               rate(current.dropped_, previous.dropped_, seconds),
+               rate(current.repeats_, previous.repeats_, seconds),
+               rate(current.syncTimeouts_, previous.syncTimeouts_, seconds),
+               rate(current.empty_, previous.empty_, seconds),
+               rate(current.writeBusy_, previous.writeBusy_, seconds),
+               rate(current.blocked_, previous.blocked_, seconds),
+               rate(current.staleReaders_, previous.staleReaders_, seconds));
+        for(u32 j = 0; j < numReaders; ++j) {
+            const VCamPipe::ReaderInfo& reader = readers[j];
+            printf("  reader %u  %-8s depth %u  queued %u  skipped %u  overflowed %u%s\n", reader.index_, getReadName(reader.policy_), reader.targetDepth_,
+                   reader.queued_, reader.skipped_, reader.overflowed_, reader.stale_ ? "  stale" : "");
+        }
+        printf("  tiles/s copied %.1f skipped %.1f  duplicates/s %.1f\n",
+               rate(current.tilesCopied_, previous.tilesCopied_, seconds),
+               rate(current.tilesSkipped_, previous.tilesSkipped_, seconds),
+               rate(current.duplicates_, previous.duplicates_, seconds));
+        printf("  samples/s reused %.1f patched %.1f late %.1f  rows skipped/s %.1f\n",
+               rate(current.samplesReused_, previous.samplesReused_, seconds),
+               rate(current.samplesPatched_, previous.samplesPatched_, seconds),
+               rate(current.lateSamples_, previous.lateSamples_, seconds),
+               rate(current.rowsSkipped_, previous.rowsSkipped_, seconds));
+        printHistogram("latency", current.latency_, previous.latency_);
+        printHistogram("write", current.writeTime_, previous.writeTime_);
+        printHistogram("block", current.blockTime_, previous.blockTime_);
+        printHistogram("wait", current.waitTime_, previous.waitTime_);
+        printHistogram("read", current.readTime_, previous.readTime_);
+        printHistogram("fill", current.fillTime_, previous.fillTime_);
+        fflush(stdout);
+    }
+    return 0;
+}